@@ -0,0 +1,59 @@
+#include "buildings.h"
+#include "gis.h"
+
+BuildingIndex gisBuildings;
+
+void BuildingIndex::load(GISBackend &gis)
+{
+	// multipolygons come split into their parts, each indexed on its own
+	vector<string> wkt = gis.buildingPolygons();
+
+	m_polygons.clear();
+	m_polygons.reserve(wkt.size());
+	vector<BuildingEntry> entries;
+	entries.reserve(wkt.size());
+
+	for(vector<string>::iterator iter=wkt.begin(); iter != wkt.end(); iter++)
+	{
+		BuildingPolygon polygon;
+		try { boost::geometry::read_wkt(*iter, polygon); }
+		catch(std::exception &e)
+			{ cerr << "ERROR: Could not read building geometry: " << e.what() << endl; exit(1); }
+		boost::geometry::correct(polygon);	// ring orientation and closure as Boost.Geometry expects them
+
+		entries.push_back(std::make_pair(boost::geometry::return_envelope<BuildingBox>(polygon), (unsigned int) m_polygons.size()));
+		m_polygons.push_back(polygon);
+	}
+
+	// bulk loading packs the tree better than inserting one by one
+	m_tree = BuildingTree(entries.begin(), entries.end());
+	m_loaded = true;
+
+	if(m_debug) cout << "DEBUG Loaded " << m_polygons.size() << " building polygons for line of sight" << endl;
+}
+
+
+void BuildingIndex::bounds(double &xmin, double &ymin, double &xmax, double &ymax) const
+{
+	BuildingTree::bounds_type box = m_tree.bounds();
+	xmin = boost::geometry::get<boost::geometry::min_corner,0>(box);
+	ymin = boost::geometry::get<boost::geometry::min_corner,1>(box);
+	xmax = boost::geometry::get<boost::geometry::max_corner,0>(box);
+	ymax = boost::geometry::get<boost::geometry::max_corner,1>(box);
+}
+
+
+bool BuildingIndex::intersects(float x1, float y1, float x2, float y2) const
+{
+	BuildingSegment sight(BuildingPoint(x1,y1), BuildingPoint(x2,y2));
+	BuildingBox bounds = boost::geometry::return_envelope<BuildingBox>(sight);
+
+	// boxes are a coarse filter, a single exact hit is enough to block the line
+	for(BuildingTree::const_query_iterator iter=m_tree.qbegin(boost::geometry::index::intersects(bounds));
+			iter != m_tree.qend(); iter++)
+	{
+		if(boost::geometry::intersects(sight, m_polygons[iter->second]))
+			return true;
+	}
+	return false;
+}
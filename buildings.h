@@ -0,0 +1,49 @@
+#ifndef BUILDINGS_H_
+#define BUILDINGS_H_
+
+#include "gissumo.h"
+#include "gisbackend.h"
+extern bool m_debug;
+
+
+/* Building footprints (GIS_BUILDINGSTABLE, edificios feattyp 9790) held in memory for line of sight tests.
+ * Buildings don't change during a run, so they are read from the backend once and indexed by
+ * bounding box in an R-tree. A sight line is then checked exactly against the few
+ * footprints whose boxes it crosses, giving the same answer as ST_Intersects.
+ */
+class BuildingIndex {
+public:
+	BuildingIndex() : m_loaded(false) {}
+
+	// Reads every building polygon from the backend and builds the index.
+	void load(GISBackend &gis);
+
+	// Returns true once load() has run.
+	bool loaded() const { return m_loaded; }
+
+	// Number of polygons indexed (multipolygons count once per part).
+	size_t size() const { return m_polygons.size(); }
+
+	// Returns the box around every building. Only meaningful once something is loaded.
+	void bounds(double &xmin, double &ymin, double &xmax, double &ymax) const;
+
+	// Returns true if the segment (x1,y1)-(x2,y2) touches or crosses any building.
+	bool intersects(float x1, float y1, float x2, float y2) const;
+
+private:
+	typedef boost::geometry::model::d2::point_xy<double> BuildingPoint;
+	typedef boost::geometry::model::polygon<BuildingPoint> BuildingPolygon;
+	typedef boost::geometry::model::box<BuildingPoint> BuildingBox;
+	typedef boost::geometry::model::segment<BuildingPoint> BuildingSegment;
+	typedef std::pair<BuildingBox, unsigned int> BuildingEntry;	// bounding box, position in m_polygons
+	typedef boost::geometry::index::rtree< BuildingEntry, boost::geometry::index::rstar<16> > BuildingTree;
+
+	bool m_loaded;
+	vector<BuildingPolygon> m_polygons;
+	BuildingTree m_tree;
+};
+
+// Buildings used by GIS_isLineOfSight() once loaded.
+extern BuildingIndex gisBuildings;
+
+#endif /* BUILDINGS_H_ */
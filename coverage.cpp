@@ -0,0 +1,198 @@
+#include "coverage.h"
+#include "gis.h"
+
+CoverageTracker *gisCoverage = NULL;
+
+// Which of GIS_isLineOfSight()'s sources answers, as stored in CoverageHeader.
+static uint32_t lineOfSightSource()
+{
+	if(gisVisibility.loaded()) return 2;
+	if(gisBuildings.loaded()) return 1;
+	return 0;
+}
+
+// Cache file of an RSU location, coordinates in microdegrees.
+static string coverageFile(const string &cacheDir, const RSU &rsu)
+{
+	return cacheDir + "/rsu_" + boost::lexical_cast<string>(lround(rsu.xgeo*1e6))
+			+ "_" + boost::lexical_cast<string>(lround(rsu.ygeo*1e6)) + ".cov";
+}
+
+
+void computeStaticCoverage(GISBackend &gis, RSU &rsu)
+{
+	for(short xx=0; xx<PARKEDCELLCOVERAGE; xx++)
+		for(short yy=0; yy<PARKEDCELLCOVERAGE; yy++)
+		{
+			// center of the cell, cells count east and south of the reference corner
+			int xcell = rsu.xcell + xx - PARKEDCELLRANGE;
+			int ycell = rsu.ycell + yy - PARKEDCELLRANGE;
+			float xcenter = XREFERENCE + (xcell+0.5)/3600.0;
+			float ycenter = YREFERENCE - (ycell+0.5)/3600.0;
+
+			// planar distance in degrees, as GIS_distanceToPointGID() measures it
+			double dx = (double)xcenter - rsu.xgeo;
+			double dy = (double)ycenter - rsu.ygeo;
+			unsigned short distance = (unsigned short) ((float)sqrt(dx*dx + dy*dy)/METERSTODEGREES);
+
+			bool los = GIS_isLineOfSight(gis, rsu.xgeo, rsu.ygeo, xcenter, ycenter);
+			rsu.coverage[xx][yy] = getSignalQuality(distance, los);
+		}
+}
+
+
+void loadStaticCoverage(GISBackend &gis, RSU &rsu, const string &cacheDir)
+{
+	string filename = coverageFile(cacheDir, rsu);
+
+	// a cache file for another map, size, or line of sight source is computed again
+	ifstream in(filename.c_str(), ios::in | ios::binary);
+	CoverageHeader header;
+	if(in.read(reinterpret_cast<char*>(&header), sizeof(header))
+			&& !memcmp(header.magic, COVERAGE_MAGIC, sizeof(header.magic))
+			&& header.version==COVERAGE_VERSION && header.size==PARKEDCELLCOVERAGE
+			&& header.lineOfSight==lineOfSightSource()
+			&& header.xreference==XREFERENCE && header.yreference==YREFERENCE
+			&& header.xgeo==rsu.xgeo && header.ygeo==rsu.ygeo)
+	{
+		bool complete = true;
+		for(short xx=0; xx<PARKEDCELLCOVERAGE && complete; xx++)
+			complete = (bool) in.read(reinterpret_cast<char*>(&rsu.coverage[xx][0]), PARKEDCELLCOVERAGE*sizeof(unsigned short));
+		if(complete)
+		{
+			if(m_debug) cout << "DEBUG Loaded static coverage of RSU " << rsu.id << " from " << filename << endl;
+			return;
+		}
+	}
+	in.close();
+
+	computeStaticCoverage(gis, rsu);
+	if(m_debug) cout << "DEBUG Computed static coverage of RSU " << rsu.id << endl;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, COVERAGE_MAGIC, sizeof(header.magic));
+	header.version = COVERAGE_VERSION;
+	header.size = PARKEDCELLCOVERAGE;
+	header.lineOfSight = lineOfSightSource();
+	header.xreference = XREFERENCE;
+	header.yreference = YREFERENCE;
+	header.xgeo = rsu.xgeo;
+	header.ygeo = rsu.ygeo;
+
+	ofstream out(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for(short xx=0; xx<PARKEDCELLCOVERAGE; xx++)
+		out.write(reinterpret_cast<const char*>(&rsu.coverage[xx][0]), PARKEDCELLCOVERAGE*sizeof(unsigned short));
+	out.close();
+	if(out.fail())
+		{ cerr << "ERROR: Could not write RSU coverage " << filename << endl; exit(1); }
+
+	if(m_debug) cout << "DEBUG Wrote static coverage of RSU " << rsu.id << " to " << filename << endl;
+}
+
+
+void CoverageTracker::pointMoved(unsigned int gid, float xgeo, float ygeo)
+{
+	unsigned short xcell, ycell;
+	determineCellFromWGS84(xgeo, ygeo, xcell, ycell);
+	uint32_t cell = cellKey(xcell, ycell);
+
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+	std::pair<std::unordered_map<unsigned int,uint32_t>::iterator,bool> known = m_pointCells.insert(std::make_pair(gid, cell));
+	if(!known.second)
+	{
+		if(known.first->second == cell) return;	// same cell, nothing to redo
+
+		// leave the old cell
+		vector<unsigned int> &before = m_occupants[known.first->second];
+		before.erase(find(before.begin(), before.end(), gid));
+		m_changed.push_back(known.first->second);
+		known.first->second = cell;
+	}
+
+	m_occupants[cell].push_back(gid);
+	m_changed.push_back(cell);
+}
+
+
+void CoverageTracker::clear()
+{
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+	m_pointCells.clear();
+	m_occupants.clear();
+	m_changed.clear();
+}
+
+
+bool CoverageTracker::cellSignal(GISBackend &gis, const RSU &rsu, uint32_t cell, unsigned short &signal, bool debug)
+{
+	/* updateRSUCoverage() writes every neighbor in range into its cell in gid order, so the
+	 * cell ends up with the signal of its highest gid in range, the RSU itself (distance 0) aside.
+	 * Range and distance are measured as GIS_getNeighborsInRange() does from gisPoints.
+	 */
+	float wgs84range = MAXRANGE*METERSTODEGREES;
+	double range2 = (double)wgs84range*wgs84range;
+
+	std::unordered_map< uint32_t, vector<unsigned int> >::iterator occupants = m_occupants.find(cell);
+	if(occupants == m_occupants.end()) return false;
+
+	bool found = false;
+	unsigned int best = 0;
+	float xbest = 0, ybest = 0;
+	unsigned short distbest = 0;
+	for(vector<unsigned int>::iterator iter=occupants->second.begin(); iter != occupants->second.end(); iter++)
+	{
+		if(found && *iter < best) continue;
+
+		float xgeo, ygeo;
+		if(!gisPoints.coords(*iter, xgeo, ygeo)) continue;
+		double dx = (double)xgeo - rsu.xgeo;
+		double dy = (double)ygeo - rsu.ygeo;
+		if(dx*dx + dy*dy > range2) continue;
+		unsigned short distance = (unsigned short) ((float)sqrt(dx*dx + dy*dy)/METERSTODEGREES);
+		if(!distance) continue;
+
+		found = true;
+		best = *iter;
+		xbest = xgeo;
+		ybest = ygeo;
+		distbest = distance;
+	}
+	if(!found) return false;
+
+	bool los = GIS_isLineOfSight(gis, rsu.xgeo, rsu.ygeo, xbest, ybest);
+	signal = getSignalQuality(distbest, los);
+	if(debug) cout << "DEBUG\t RSU " << rsu.id << " cell xcell=" << (cell>>16) << " ycell=" << (cell&0xFFFF)
+			<< " from gid=" << best << " distance " << distbest << " LOS " << (los?"true":"false") << " signal " << signal << '\n';
+	return true;
+}
+
+
+void CoverageTracker::update(GISBackend &gis, list<RSU> &rsuList, CityMapNum &globalSignal, bool debug)
+{
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+	sort(m_changed.begin(), m_changed.end());
+	m_changed.erase(unique(m_changed.begin(), m_changed.end()), m_changed.end());
+
+	for(list<RSU>::iterator iterRSU = rsuList.begin(); iterRSU != rsuList.end(); iterRSU++)
+		for(vector<uint32_t>::iterator cell=m_changed.begin(); cell != m_changed.end(); cell++)
+		{
+			unsigned short xcell = *cell >> 16, ycell = *cell & 0xFFFF;
+			int xrelative = PARKEDCELLRANGE + xcell - iterRSU->xcell;
+			int yrelative = PARKEDCELLRANGE + ycell - iterRSU->ycell;
+			if(xrelative<0 || xrelative>=PARKEDCELLCOVERAGE || yrelative<0 || yrelative>=PARKEDCELLCOVERAGE)
+				continue;
+
+			// a cell nobody in range is in keeps what it last observed, as with updateRSUCoverage()
+			unsigned short signal;
+			if(!cellSignal(gis, *iterRSU, *cell, signal, debug)) continue;
+			iterRSU->coverage[xrelative][yrelative] = signal;
+
+			// patch the global map, as applyCoverageToCityMap() would
+			if(signal > globalSignal.get(xcell,ycell))
+				globalSignal.set(xcell, ycell, signal);
+		}
+
+	if(m_debug) cout << "DEBUG CoverageTracker updated " << m_changed.size() << " changed cells" << endl;
+	m_changed.clear();
+}
@@ -0,0 +1,80 @@
+#ifndef COVERAGE_H_
+#define COVERAGE_H_
+
+#include <fstream>
+#include <cstring>
+#include <boost/thread/mutex.hpp>
+#include "gissumo.h"
+#include "gisbackend.h"
+extern bool m_debug;
+
+
+/* Static RSU coverage. RSUs don't move and neither do buildings, so an RSU's coverage
+ * can be worked out once, for every cell around it rather than only the cells that
+ * vehicles happen to be in: a sight line from the RSU to each cell center within
+ * PARKEDCELLRANGE, graded with getSignalQuality().
+ *
+ * Rasters are cached on disk, one file per RSU location, and reused by later runs on the
+ * same map. File layout: CoverageHeader, then the PARKEDCELLCOVERAGE^2 raster as uint16,
+ * row by row of the RSU's coverage array. Values are stored in host byte order.
+ */
+#define COVERAGE_MAGIC "GSRSUCOV"
+#define COVERAGE_VERSION 1
+
+struct CoverageHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t size;			// PARKEDCELLCOVERAGE
+	uint32_t lineOfSight;	// what answered line of sight: 0 the backend, 1 gisBuildings, 2 gisVisibility
+	uint32_t reserved;
+	double xreference;		// XREFERENCE and YREFERENCE of the map it was computed for
+	double yreference;
+	float xgeo;				// the RSU's location
+	float ygeo;
+};
+
+// Fills the RSU's coverage array with the signal from the RSU to every cell center in range.
+// Prints nothing, so it can run on worker threads (see RSUPlacement).
+void computeStaticCoverage(GISBackend &gis, RSU &rsu);
+
+// Fills the RSU's coverage array from its file in cacheDir, or computes it and writes the file
+// when there is none yet or it was computed for another map or with another line of sight source.
+void loadStaticCoverage(GISBackend &gis, RSU &rsu, const string &cacheDir);
+
+
+
+/* Vehicle-driven RSU coverage, the same observed coverage as updateRSUCoverage(), kept up to
+ * date incrementally. Each point's cell is tracked as the GIS functions add and move points,
+ * and only cells that a point entered or left are recomputed, for the RSUs whose
+ * PARKEDCELLRANGE window holds them. A cell's signal is refreshed when its occupants change,
+ * not as they move around inside it.
+ */
+class CoverageTracker {
+public:
+	// Notes a point's position after it was added or moved. Only a change of cell matters.
+	void pointMoved(unsigned int gid, float xgeo, float ygeo);
+
+	// Forgets every point.
+	void clear();
+
+	// Recomputes the RSU coverage cells whose occupants changed since the last call,
+	// and raises globalSignal where they got better.
+	void update(GISBackend &gis, list<RSU> &rsuList, CityMapNum &globalSignal, bool debug);
+
+private:
+	std::unordered_map<unsigned int, uint32_t> m_pointCells;		// gid -> cell key
+	std::unordered_map< uint32_t, vector<unsigned int> > m_occupants;	// cell key -> gids in it
+	vector<uint32_t> m_changed;		// cells that gained or lost a point since update()
+	boost::mutex m_mutex;			// points may be added from any thread
+
+	static uint32_t cellKey(unsigned short xcell, unsigned short ycell) { return ((uint32_t)xcell << 16) | ycell; }
+
+	// Returns the signal an RSU gets from a cell, false if no point in it is in range.
+	bool cellSignal(GISBackend &gis, const RSU &rsu, uint32_t cell, unsigned short &signal, bool debug);
+};
+
+// Tracks point cells for incremental coverage, NULL if off.
+extern CoverageTracker *gisCoverage;
+
+#endif /* COVERAGE_H_ */
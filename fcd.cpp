@@ -0,0 +1,778 @@
+#include "fcd.h"
+
+VehicleIDTable fcdVehicleIDs;
+
+bool FCDFilter::accepts(float xgeo, float ygeo, unsigned short xcell, unsigned short ycell) const
+{
+	if(bbox && (xgeo<xmin || xgeo>xmax || ygeo<ymin || ygeo>ymax))
+		return false;
+
+	// cells are measured off the reference corner in absolute value, so points west of
+	// or north of it fold back onto the map and have to be ruled out separately
+	if(clipToMap && (xgeo<XREFERENCE || ygeo>YREFERENCE || xcell>=CITYWIDTH || ycell>=CITYHEIGHT))
+		return false;
+
+	return true;
+}
+
+
+void FCDSource::readError(const string &message)
+{
+	if(m_throwErrors) throw FCDReadError(message);
+	cerr << "ERROR: " << message << endl;
+	exit(1);
+}
+
+
+FCDReader::FCDReader(const string &filename, const FCDFilter &filter) :
+		m_filename(filename), m_filter(filter), m_finished(false), m_readBuffer(1<<16), m_ids(&fcdVehicleIDs)
+{
+	if(filename=="-")
+	{
+		m_fdBuffer.open(boost::iostreams::file_descriptor_source(STDIN_FILENO, boost::iostreams::never_close_handle), m_readBuffer.size());
+		attachStream(&m_fdBuffer);
+		return;
+	}
+
+	// a larger stream buffer cuts down on read() calls on multi-GB traces
+	m_file.rdbuf()->pubsetbuf(&m_readBuffer[0], m_readBuffer.size());
+	m_file.open(filename.c_str(), ios::in | ios::binary);
+	if(!m_file.is_open())
+		{ cerr << "ERROR: Could not open FCD file " << filename << endl; exit(1); }
+	attachStream(m_file.rdbuf());
+}
+
+
+FCDReader::FCDReader(int fd, const string &name, const FCDFilter &filter) :
+		m_filename(name), m_filter(filter), m_finished(false), m_ids(&fcdVehicleIDs)
+{
+	m_fdBuffer.open(boost::iostreams::file_descriptor_source(fd, boost::iostreams::close_handle), 1<<16);
+	attachStream(&m_fdBuffer);
+}
+
+
+FCDReader::FCDReader(streambuf *raw, const string &name, const FCDFilter &filter, VehicleIDTable &ids) :
+		m_filename(name), m_filter(filter), m_finished(false), m_ids(&ids)
+{
+	attachStream(raw);
+}
+
+
+void FCDReader::attachStream(streambuf *raw)
+{
+	/* Compressed files are told apart by the first byte of their magic number, none of which
+	 * can start an XML document: gzip 1f 8b, xz fd 37 7a 58 5a 00, zstd 28 b5 2f fd.
+	 * Peeking doesn't consume anything, so the decompressor still sees the whole stream.
+	 */
+	switch(raw->sgetc())
+	{
+		case 0x1f: m_decompressor.push(boost::iostreams::gzip_decompressor()); break;
+		case 0xfd: m_decompressor.push(boost::iostreams::lzma_decompressor()); break;
+		case 0x28: m_decompressor.push(boost::iostreams::zstd_decompressor()); break;
+	}
+
+	if(m_decompressor.empty())
+		m_buf = raw;
+	else
+	{
+		m_decompressor.push(*raw, 1<<16);
+		m_buf = &m_decompressor;
+	}
+}
+
+
+bool FCDReader::nextTimestep(Timestep &t)
+{
+	try { return readTimestep(t); }
+	catch(FCDReadError&) { throw; }
+	catch(std::exception &e)	// corrupt compressed data
+		{ readError("Could not read FCD file " + m_filename + ": " + e.what()); return false; }
+}
+
+
+bool FCDReader::readTimestep(Timestep &t)
+{
+	// skip everything up to the next <timestep>
+	while(!m_finished && nextTag())
+	{
+		if(!tagIs("timestep")) continue;
+
+		t.time = getAttributeAsDouble("time");
+		t.records.clear();	// keeps its capacity, so memory stays at the largest timestep seen
+
+		// timesteps before the window are scanned past without decoding any vehicle
+		bool skip = t.time < m_filter.startTime;
+		if(m_filter.stopTime && t.time>=m_filter.stopTime)
+			m_finished = true;
+
+		// SUMO writes timesteps without vehicles as <timestep time=""/>
+		if(tagIsEmpty())
+		{
+			if(skip) continue;
+			return true;
+		}
+
+		// read vehicles until </timestep>, ignoring other entities (e.g. persons)
+		while(nextTag() && !tagIs("/timestep"))
+		{
+			if(skip || !tagIs("vehicle")) continue;
+
+			double xgeo = getAttributeAsDouble("x");	// kept in full for setPosition()
+			double ygeo = getAttributeAsDouble("y");
+			unsigned short xcell, ycell;
+			determineCellFromWGS84(xgeo, ygeo, xcell, ycell);
+			if(!m_filter.accepts(xgeo, ygeo, xcell, ycell)) continue;
+
+			TraceRecord rec;
+			string id;
+			getAttribute("id",id);
+			rec.id = m_ids->intern(id);
+			rec.setPosition(xgeo, ygeo);
+			rec.xcell = xcell;
+			rec.ycell = ycell;
+			rec.setSpeed(getAttributeAsDouble("speed"));
+
+			t.records.push_back(rec);
+		}
+		if(skip) continue;
+		return true;
+	}
+	return false;
+}
+
+
+bool FCDReader::nextTag()
+{
+	const int eof = char_traits<char>::eof();
+	int c;
+
+	// skip character data up to the next tag
+	do {
+		c = m_buf->sbumpc();
+		if(c==eof) return false;
+	} while(c!='<');
+
+	m_tag.clear();
+	while( (c=m_buf->sbumpc()) != eof )
+	{
+		if(c=='>')
+		{
+			// comments can hold '>' (SUMO writes its whole configuration into one), read on until '-->'
+			bool isComment = m_tag.compare(0,3,"!--")==0;
+			if(!isComment || (m_tag.size()>=5 && m_tag.compare(m_tag.size()-2,2,"--")==0))
+				return true;
+		}
+		m_tag.push_back(c);
+	}
+	return false;	// truncated tag at end of file
+}
+
+
+// XML whitespace, as the scanner reads it; isspace() is undefined for the negative chars of UTF-8 names.
+static bool isXMLSpace(char c)
+{
+	return c==' ' || c=='\t' || c=='\r' || c=='\n';
+}
+
+
+bool FCDReader::tagIs(const char *name) const
+{
+	size_t len = strlen(name);
+	return m_tag.compare(0,len,name)==0
+			&& (m_tag.size()==len || isXMLSpace(m_tag[len]) || m_tag[len]=='/');
+}
+
+
+bool FCDReader::tagIsEmpty() const
+{
+	return !m_tag.empty() && m_tag[m_tag.size()-1]=='/';
+}
+
+
+bool FCDReader::getAttribute(const char *name, string &value) const
+{
+	const char *whitespace = " \t\r\n";
+	size_t len = strlen(name);
+
+	// skip the tag name, then walk name="value" pairs
+	size_t pos = m_tag.find_first_of(whitespace);
+	while(pos!=string::npos)
+	{
+		pos = m_tag.find_first_not_of(whitespace, pos);
+		if(pos==string::npos) return false;
+
+		size_t equals = m_tag.find('=', pos);
+		if(equals==string::npos) return false;
+		size_t open = m_tag.find_first_of("\"'", equals);
+		if(open==string::npos) return false;
+		size_t close = m_tag.find(m_tag[open], open+1);
+		if(close==string::npos) return false;
+
+		size_t nameEnd = equals;
+		while(nameEnd>pos && isXMLSpace(m_tag[nameEnd-1])) nameEnd--;
+
+		if(nameEnd-pos==len && m_tag.compare(pos,len,name)==0)
+		{
+			value.assign(m_tag, open+1, close-open-1);
+			if(value.find('&')!=string::npos)
+			{
+				replace_all(value,"&lt;","<");
+				replace_all(value,"&gt;",">");
+				replace_all(value,"&quot;","\"");
+				replace_all(value,"&apos;","'");
+				replace_all(value,"&amp;","&");
+			}
+			return true;
+		}
+		pos = close+1;
+	}
+	return false;
+}
+
+
+double FCDReader::getAttributeAsDouble(const char *name) const
+{
+	string value;
+	if(!getAttribute(name,value)) return 0;
+
+	char *end;
+	double result = strtod(value.c_str(), &end);
+	if(end==value.c_str() || *end!='\0') return 0;
+	return result;
+}
+
+
+// Orders index entries by time, for seeking to the start of the time window.
+static bool indexEntryBefore(const FCDBinaryIndexEntry &entry, float time)
+{
+	return entry.time < time;
+}
+
+// Whether 'count' values of 'size' bytes at 'offset' fit in the mapping, without overflowing on a bad header.
+static bool columnFits(uint64_t mapSize, uint64_t offset, uint64_t count, size_t size)
+{
+	return offset <= mapSize && count <= (mapSize-offset)/size;
+}
+
+FCDBinaryReader::FCDBinaryReader(const string &filename, const FCDFilter &filter) : m_next(0), m_filter(filter)
+{
+	try { m_map.open(filename); }
+	catch(std::exception &e)
+		{ cerr << "ERROR: Could not map FCD file " << filename << ": " << e.what() << endl; exit(1); }
+
+	m_header = reinterpret_cast<const FCDBinaryHeader*>(m_map.data());
+	if(m_map.size() < sizeof(FCDBinaryHeader)
+			|| memcmp(m_header->magic, FCDBINARY_MAGIC, sizeof(m_header->magic))!=0
+			|| m_header->version != FCDBINARY_VERSION)
+		{ cerr << "ERROR: " << filename << " is not a version " << FCDBINARY_VERSION << " binary trace." << endl; exit(1); }
+
+	// make sure every column fits inside the file before handing out pointers into it
+	uint64_t records = m_header->records;
+	uint64_t mapSize = m_map.size();
+	if(!columnFits(mapSize, m_header->indexOffset, m_header->timesteps, sizeof(FCDBinaryIndexEntry))
+			|| m_header->namesOffset > mapSize
+			|| !columnFits(mapSize, m_header->idOffset, records, sizeof(uint32_t))
+			|| !columnFits(mapSize, m_header->xOffset, records, sizeof(float))
+			|| !columnFits(mapSize, m_header->yOffset, records, sizeof(float))
+			|| !columnFits(mapSize, m_header->speedOffset, records, sizeof(float)))
+		{ cerr << "ERROR: Binary trace " << filename << " is truncated." << endl; exit(1); }
+
+	m_index = reinterpret_cast<const FCDBinaryIndexEntry*>(m_map.data() + m_header->indexOffset);
+	m_id = reinterpret_cast<const uint32_t*>(m_map.data() + m_header->idOffset);
+	m_x = reinterpret_cast<const float*>(m_map.data() + m_header->xOffset);
+	m_y = reinterpret_cast<const float*>(m_map.data() + m_header->yOffset);
+	m_speed = reinterpret_cast<const float*>(m_map.data() + m_header->speedOffset);
+
+	// every timestep's records must lie inside the columns, in time order for the seek below
+	for(uint64_t step=0; step<m_header->timesteps; step++)
+	{
+		const FCDBinaryIndexEntry &entry = m_index[step];
+		if(entry.first > records || entry.count > records - entry.first
+				|| (step && !(entry.time >= m_index[step-1].time)))
+			{ cerr << "ERROR: Binary trace " << filename << " has a corrupt index." << endl; exit(1); }
+	}
+
+	// intern the file's IDs, in case other sources already handed out slots
+	const char *name = m_map.data() + m_header->namesOffset;
+	const char *end = m_map.data() + m_map.size();
+	for(uint64_t slot=0; slot<m_header->names; slot++)
+	{
+		const char *terminator = static_cast<const char*>(memchr(name, '\0', end-name));
+		if(!terminator)
+			{ cerr << "ERROR: Binary trace " << filename << " is truncated." << endl; exit(1); }
+		m_slots.push_back(fcdVehicleIDs.intern(string(name, terminator)));
+		name = terminator+1;
+	}
+
+	// timesteps are stored in time order, so the window start is a binary search away
+	m_next = lower_bound(m_index, m_index+m_header->timesteps, m_filter.startTime, indexEntryBefore) - m_index;
+}
+
+
+bool FCDBinaryReader::nextTimestep(Timestep &t)
+{
+	if(m_next >= m_header->timesteps) return false;
+
+	const FCDBinaryIndexEntry &entry = m_index[m_next++];
+	t.time = entry.time;
+	t.records.clear();
+
+	// stop after the first timestep at or past the stop time
+	if(m_filter.stopTime && t.time>=m_filter.stopTime)
+		m_next = m_header->timesteps;
+
+	for(uint64_t rec=entry.first; rec<entry.first+entry.count; rec++)
+	{
+		unsigned short xcell, ycell;
+		determineCellFromWGS84(m_x[rec], m_y[rec], xcell, ycell);
+		if(!m_filter.accepts(m_x[rec], m_y[rec], xcell, ycell)) continue;
+
+		if(m_id[rec] >= m_slots.size())
+			{ readError("Binary trace record " + lexical_cast<string>(rec) + " has an unknown vehicle ID."); return false; }
+
+		TraceRecord record;
+		record.id = m_slots[m_id[rec]];
+		record.setPosition(m_x[rec], m_y[rec]);
+		record.xcell = xcell;
+		record.ycell = ycell;
+		record.setSpeed(m_speed[rec]);
+		t.records.push_back(record);
+	}
+	return true;
+}
+
+
+FCDPipeline::FCDPipeline(std::unique_ptr<FCDSource> source, unsigned int depth) :
+		m_source(std::move(source)), m_ring(depth), m_head(0), m_count(0), m_done(false), m_stop(false)
+{
+	// read errors are handed to the consumer, the reader thread doesn't end the program
+	m_source->throwErrors();
+	m_thread = boost::thread(&FCDPipeline::produce, this);
+}
+
+
+FCDPipeline::~FCDPipeline()
+{
+	// the consumer may leave early (--stop-time), unblock the reader thread before joining it
+	{
+		boost::lock_guard<boost::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_changed.notify_all();
+	m_thread.join();
+}
+
+
+bool FCDPipeline::nextTimestep(Timestep &t)
+{
+	boost::unique_lock<boost::mutex> lock(m_mutex);
+	while(!m_count && !m_done)
+		m_changed.wait(lock);
+	if(!m_count && !m_error.empty())
+		{ cerr << "ERROR: " << m_error << endl; exit(1); }
+	if(!m_count) return false;
+
+	// hand the decoded buffer over and give the caller's old one back to the ring for reuse
+	swap(t, m_ring[m_head]);
+	m_head = (m_head+1) % m_ring.size();
+	m_count--;
+	lock.unlock();
+	m_changed.notify_all();
+	return true;
+}
+
+
+void FCDPipeline::produce()
+{
+	while(true)
+	{
+		// wait for a free buffer
+		size_t slot;
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			while(m_count==m_ring.size() && !m_stop)
+				m_changed.wait(lock);
+			if(m_stop) return;
+			slot = (m_head+m_count) % m_ring.size();
+		}
+
+		// decode outside the lock, the consumer never touches a slot that isn't counted yet
+		bool more;
+		string error;
+		try { more = m_source->nextTimestep(m_ring[slot]); }
+		catch(FCDReadError &e) { more = false; error = e.what(); }
+
+		{
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			if(more) m_count++; else { m_done=true; m_error=error; }
+		}
+		m_changed.notify_all();
+		if(!more) return;
+	}
+}
+
+
+FCDMemorySource::FCDMemorySource(vector<Timestep> &timesteps) : m_next(0)
+{
+	m_timesteps.swap(timesteps);
+}
+
+
+bool FCDMemorySource::nextTimestep(Timestep &t)
+{
+	if(m_next==m_timesteps.size()) return false;
+
+	swap(t, m_timesteps[m_next]);
+	std::vector<TraceRecord>().swap(m_timesteps[m_next].records);	// frees what the caller gave back
+	m_next++;
+	return true;
+}
+
+
+#define NOSAMPLE 0xffffffff
+
+TrajectoryInterpolator::SlotSamples& TrajectoryInterpolator::samplesOf(unsigned int slot)
+{
+	if(slot >= m_slots.size())
+	{
+		SlotSamples none = { 0, NOSAMPLE, NOSAMPLE };
+		m_slots.resize(slot+1, none);
+	}
+
+	SlotSamples &samples = m_slots[slot];
+	if(samples.generation != m_generation)
+	{
+		samples.generation = m_generation;
+		samples.from = samples.to = NOSAMPLE;
+	}
+	return samples;
+}
+
+
+void TrajectoryInterpolator::setInterval(const Timestep &from, const Timestep &to)
+{
+	m_from = &from;
+	m_to = &to;
+	m_generation++;
+
+	for(uint32_t rec=0; rec<from.records.size(); rec++)
+		samplesOf(from.records[rec].id).from = rec;
+	for(uint32_t rec=0; rec<to.records.size(); rec++)
+		samplesOf(to.records[rec].id).to = rec;
+}
+
+
+bool TrajectoryInterpolator::positionAt(unsigned int slot, float time, float &xgeo, float &ygeo) const
+{
+	if(slot >= m_slots.size() || m_slots[slot].generation != m_generation || m_slots[slot].from == NOSAMPLE)
+		return false;
+
+	const TraceRecord &a = m_from->records[m_slots[slot].from];
+	if(m_slots[slot].to == NOSAMPLE || m_to->time <= m_from->time)
+	{
+		xgeo = a.xgeo();
+		ygeo = a.ygeo();
+		return true;
+	}
+
+	// interpolate in fixed point, which holds more precision than the float coordinates
+	const TraceRecord &b = m_to->records[m_slots[slot].to];
+	double fraction = (time - m_from->time) / (m_to->time - m_from->time);
+	xgeo = (a.xfix + (b.xfix - a.xfix)*fraction) / TRACE_COORDSCALE;
+	ygeo = (a.yfix + (b.yfix - a.yfix)*fraction) / TRACE_COORDSCALE;
+	return true;
+}
+
+
+bool FCD_isBinaryFile(const string &filename)
+{
+	char magic[8];
+	ifstream file(filename.c_str(), ios::in | ios::binary);
+	return file.read(magic, sizeof(magic)) && memcmp(magic, FCDBINARY_MAGIC, sizeof(magic))==0;
+}
+
+
+bool FCD_isRegularFile(const string &filename)
+{
+	struct stat info;
+	return filename!="-" && stat(filename.c_str(), &info)==0 && S_ISREG(info.st_mode);
+}
+
+
+std::unique_ptr<FCDSource> FCD_openSource(const string &filename, const FCDFilter &filter, unsigned int parseThreads)
+{
+	// stdin and named pipes can only be read once, and only as they are written
+	if(!FCD_isRegularFile(filename))
+		return std::unique_ptr<FCDSource>(new FCDReader(filename, filter));
+
+	if(FCD_isBinaryFile(filename))
+		return std::unique_ptr<FCDSource>(new FCDBinaryReader(filename, filter));
+
+	// compressed files have to be inflated in order, they are never split
+	if(parseThreads > 1)
+	{
+		ifstream file(filename.c_str(), ios::in | ios::binary);
+		int first = file.get();
+		if(first!=0x1f && first!=0xfd && first!=0x28)
+			return FCD_readParallel(filename, filter, parseThreads);
+		if(m_debug) cout << "DEBUG " << filename << " is compressed, parsing it on one thread" << endl;
+	}
+	return std::unique_ptr<FCDSource>(new FCDReader(filename, filter));
+}
+
+
+// Returns the position of the first <timestep> tag at or after 'from', or 'size' if there is none.
+static size_t findTimestepTag(const char *data, size_t size, size_t from)
+{
+	static const char tag[] = "<timestep";
+	const size_t length = sizeof(tag)-1;
+
+	while(from+length < size)
+	{
+		const char *open = (const char*) memchr(data+from, '<', size-from);
+		if(!open) break;
+		size_t pos = open-data;
+
+		// "<timestep" followed by anything but whitespace, '>' or '/' is some other tag
+		if(pos+length < size && memcmp(open, tag, length)==0)
+		{
+			char next = open[length];
+			if(next==' ' || next=='\t' || next=='\r' || next=='\n' || next=='>' || next=='/')
+				return pos;
+		}
+		from = pos+1;
+	}
+	return size;
+}
+
+
+// Parses one chunk of a mapped XML trace. Runs on a worker thread, touching nothing shared.
+// A read error is left in 'error' for the main thread to report.
+static void parseChunk(const char *data, size_t size, const FCDFilter &filter, const string &name,
+		vector<Timestep> *timesteps, VehicleIDTable *ids, string *error)
+{
+	boost::iostreams::stream_buffer<boost::iostreams::array_source> chunk(data, size);
+	FCDReader reader(&chunk, name, filter, *ids);
+	reader.throwErrors();
+
+	Timestep t;
+	try
+	{
+		while(reader.nextTimestep(t))
+		{
+			timesteps->push_back(Timestep());
+			swap(timesteps->back(), t);
+		}
+	}
+	catch(FCDReadError &e) { *error = e.what(); }
+}
+
+
+std::unique_ptr<FCDSource> FCD_readParallel(const string &filename, const FCDFilter &filter, unsigned int threads)
+{
+	boost::iostreams::mapped_file_source map;
+	try { map.open(filename); }
+	catch(std::exception &e)
+		{ cerr << "ERROR: Could not map FCD file " << filename << ": " << e.what() << endl; exit(1); }
+	const char *data = map.data();
+	size_t size = map.size();
+
+	/* Split into roughly equal chunks, each starting on a <timestep> tag. The first chunk
+	 * also takes the document header; tags past the last timestep are skipped by whichever
+	 * chunk ends up with them.
+	 */
+	vector<size_t> bounds(1, 0);
+	for(unsigned int chunk=1; chunk<threads; chunk++)
+	{
+		size_t pos = findTimestepTag(data, size, max(size/threads*chunk, bounds.back()+1));
+		if(pos==size) break;
+		bounds.push_back(pos);
+	}
+	bounds.push_back(size);
+	size_t chunks = bounds.size()-1;
+
+	vector< vector<Timestep> > parsed(chunks);
+	vector<VehicleIDTable> ids(chunks);
+	vector<string> errors(chunks);
+	boost::thread_group workers;
+	for(size_t chunk=0; chunk<chunks; chunk++)
+		workers.create_thread(boost::bind(parseChunk, data+bounds[chunk], bounds[chunk+1]-bounds[chunk],
+				boost::cref(filter), boost::cref(filename), &parsed[chunk], &ids[chunk], &errors[chunk]));
+	workers.join_all();
+	for(size_t chunk=0; chunk<chunks; chunk++)
+		if(!errors[chunk].empty())
+			{ cerr << "ERROR: " << errors[chunk] << endl; exit(1); }
+
+	/* Stitch in file order. Each chunk interned its IDs by first appearance within it, so
+	 * interning a chunk's table in slot order, chunk after chunk, hands out global slots in
+	 * first appearance order over the whole file, just like a single reader would.
+	 * Every chunk stops at its own first timestep past the stop time; only the earliest counts.
+	 */
+	vector<Timestep> timesteps;
+	vector<unsigned int> slots;
+	bool stopped = false;
+	for(size_t chunk=0; chunk<chunks && !stopped; chunk++)
+	{
+		slots.clear();
+		for(unsigned int slot=0; slot<ids[chunk].size(); slot++)
+			slots.push_back(fcdVehicleIDs.intern(ids[chunk].name(slot)));
+
+		for(vector<Timestep>::iterator t=parsed[chunk].begin(); t!=parsed[chunk].end() && !stopped; t++)
+		{
+			for(std::vector<TraceRecord>::iterator rec=t->records.begin(); rec!=t->records.end(); rec++)
+				rec->id = slots[rec->id];
+			timesteps.push_back(Timestep());
+			swap(timesteps.back(), *t);
+			if(filter.stopTime && timesteps.back().time>=filter.stopTime)
+				stopped = true;
+		}
+		vector<Timestep>().swap(parsed[chunk]);
+	}
+
+	if(m_debug) cout << "DEBUG Parsed " << timesteps.size() << " timesteps from " << filename << " in " << chunks << " chunks" << endl;
+	return std::unique_ptr<FCDSource>(new FCDMemorySource(timesteps));
+}
+
+
+std::unique_ptr<FCDSource> FCD_openSocket(unsigned short port, const FCDFilter &filter)
+{
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	if(listener<0)
+		{ cerr << "ERROR: Could not open a socket for FCD: " << strerror(errno) << endl; exit(1); }
+	int reuse = 1;
+	if(setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse))<0)
+		{ cerr << "ERROR: Could not set SO_REUSEADDR on the FCD socket: " << strerror(errno) << endl; exit(1); }
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if(::bind(listener, (sockaddr*) &address, sizeof(address))<0 || listen(listener,1)<0)
+		{ cerr << "ERROR: Could not listen for FCD on port " << port << ": " << strerror(errno) << endl; exit(1); }
+
+	if(m_debug) cout << "DEBUG Waiting for FCD on localhost:" << port << endl;
+	int connection = accept(listener, NULL, NULL);
+	close(listener);
+	if(connection<0)
+		{ cerr << "ERROR: Could not accept FCD connection on port " << port << ": " << strerror(errno) << endl; exit(1); }
+
+	return std::unique_ptr<FCDSource>(new FCDReader(connection, "localhost:"+lexical_cast<string>(port), filter));
+}
+
+
+// Rounds a file offset up to the next column boundary.
+static uint64_t alignColumn(uint64_t offset)
+{
+	return (offset+7) & ~(uint64_t)7;
+}
+
+// Spools 'count' values to a column's temporary file, false if they did not all make it.
+static bool spoolColumn(FILE *column, const void *values, size_t size, size_t count)
+{
+	return fwrite(values, size, count, column) == count;
+}
+
+// Copies a spooled column into the output, padded to 'size' bytes. False on a read or write error.
+static bool appendColumn(ofstream &out, FILE *column, uint64_t size)
+{
+	char buffer[1<<16];
+	size_t count;
+	bool complete = fflush(column)==0;
+	rewind(column);
+	while( complete && (count=fread(buffer, 1, sizeof(buffer), column)) > 0 )
+	{
+		if(count > size) { complete = false; break; }
+		out.write(buffer, count); size -= count;
+	}
+	complete = complete && !ferror(column);
+	while(complete && size--) out.put(0);
+	fclose(column);
+	return complete && out.good();
+}
+
+void FCD_writeBinary(FCDSource &source, const string &filename)
+{
+	// Columns are spooled to temporary files, as the header needs the final counts ahead of them.
+	FILE *index=tmpfile(), *ids=tmpfile(), *xs=tmpfile(), *ys=tmpfile(), *speeds=tmpfile();
+	if(!index || !ids || !xs || !ys || !speeds)
+		{ cerr << "ERROR: Could not create temporary files to convert " << filename << endl; exit(1); }
+
+	FCDBinaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FCDBINARY_MAGIC, sizeof(header.magic));
+	header.version = FCDBINARY_VERSION;
+
+	Timestep t;
+	vector<uint32_t> id; vector<float> x, y, speed;
+	while(source.nextTimestep(t))
+	{
+		FCDBinaryIndexEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.time = t.time;
+		entry.count = t.records.size();
+		entry.first = header.records;
+		bool spooled = spoolColumn(index, &entry, sizeof(entry), 1);
+
+		id.clear(); x.clear(); y.clear(); speed.clear();
+		for(std::vector<TraceRecord>::iterator iter=t.records.begin(); iter!=t.records.end(); iter++)
+		{
+			id.push_back(iter->id);
+			x.push_back(iter->xgeo());
+			y.push_back(iter->ygeo());
+			speed.push_back(iter->speed());
+		}
+		if(entry.count)
+			spooled = spooled
+					&& spoolColumn(ids, &id[0], sizeof(uint32_t), entry.count)
+					&& spoolColumn(xs, &x[0], sizeof(float), entry.count)
+					&& spoolColumn(ys, &y[0], sizeof(float), entry.count)
+					&& spoolColumn(speeds, &speed[0], sizeof(float), entry.count);
+		if(!spooled)
+			{ cerr << "ERROR: Could not spool timestep " << t.time << " to convert " << filename << ": " << strerror(errno) << endl; exit(1); }
+
+		header.timesteps++;
+		header.records += entry.count;
+	}
+
+	// the ID table holds every ID interned so far, which covers all records written
+	uint64_t namesSize = 0;
+	header.names = fcdVehicleIDs.size();
+	for(unsigned int slot=0; slot<fcdVehicleIDs.size(); slot++)
+		namesSize += fcdVehicleIDs.name(slot).size()+1;
+
+	// lay out the ID table, index and columns one after another
+	header.namesOffset = alignColumn(sizeof(header));
+	header.indexOffset = alignColumn(header.namesOffset + namesSize);
+	header.idOffset = alignColumn(header.indexOffset + header.timesteps*sizeof(FCDBinaryIndexEntry));
+	header.xOffset = alignColumn(header.idOffset + header.records*sizeof(uint32_t));
+	header.yOffset = alignColumn(header.xOffset + header.records*sizeof(float));
+	header.speedOffset = alignColumn(header.yOffset + header.records*sizeof(float));
+	uint64_t fileSize = header.speedOffset + header.records*sizeof(float);
+
+	ofstream out(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	if(!out.is_open())
+		{ cerr << "ERROR: Could not write binary trace " << filename << endl; exit(1); }
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for(uint64_t pad=sizeof(header); pad<header.namesOffset; pad++) out.put(0);
+	for(unsigned int slot=0; slot<fcdVehicleIDs.size(); slot++)
+		out.write(fcdVehicleIDs.name(slot).c_str(), fcdVehicleIDs.name(slot).size()+1);
+	for(uint64_t pad=header.namesOffset+namesSize; pad<header.indexOffset; pad++) out.put(0);
+	// evaluate every copy, so each temporary file is closed
+	bool complete = out.good();
+	complete = appendColumn(out, index, header.idOffset - header.indexOffset) && complete;
+	complete = appendColumn(out, ids, header.xOffset - header.idOffset) && complete;
+	complete = appendColumn(out, xs, header.yOffset - header.xOffset) && complete;
+	complete = appendColumn(out, ys, header.speedOffset - header.yOffset) && complete;
+	complete = appendColumn(out, speeds, fileSize - header.speedOffset) && complete;
+	out.close();
+	if(!complete || out.fail())
+	{
+		// a truncated trace would still carry a valid header, don't leave one behind
+		remove(filename.c_str());
+		cerr << "ERROR: Failed writing binary trace " << filename << endl; exit(1);
+	}
+
+	if(m_debug) cout << "DEBUG Wrote " << header.timesteps << " timesteps, " << header.records << " records to " << filename << endl;
+}
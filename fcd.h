@@ -0,0 +1,298 @@
+#ifndef FCD_H_
+#define FCD_H_
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <memory>
+#include <stdint.h>
+#include <cerrno>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
+#include <boost/iostreams/stream_buffer.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/lzma.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include "gissumo.h"
+extern bool m_debug;
+
+// SUMO vehicle IDs seen by the FCD readers; a vehicle's id is its slot in here.
+extern VehicleIDTable fcdVehicleIDs;
+
+/* Restrictions pushed down into the FCD readers, so out-of-window timesteps and
+ * out-of-area vehicles are dropped before any Vehicle is built for them.
+ */
+struct FCDFilter
+{
+	float startTime;	// skip timesteps before this time
+	float stopTime;		// end the trace after the first timestep at or past this time, 0 for no limit
+	bool bbox;			// keep only vehicles inside [xmin,xmax]x[ymin,ymax] (WGS84)
+	float xmin, ymin, xmax, ymax;
+	bool clipToMap;		// keep only vehicles that fall on a cell of the CITYWIDTH x CITYHEIGHT map
+
+	FCDFilter() : startTime(0), stopTime(0), bbox(false), xmin(0), ymin(0), xmax(0), ymax(0), clipToMap(false) {}
+
+	// Returns true if a vehicle at these coordinates and cells should be kept.
+	bool accepts(float xgeo, float ygeo, unsigned short xcell, unsigned short ycell) const;
+};
+
+
+// A trace that can't be read any further, thrown by sources set to throwErrors().
+struct FCDReadError : public std::runtime_error
+{
+	FCDReadError(const string &message) : std::runtime_error(message) {}
+};
+
+
+/* A source of FCD timesteps, read in time order.
+ */
+class FCDSource {
+public:
+	FCDSource() : m_throwErrors(false) {}
+	virtual ~FCDSource() {}
+
+	// Reads the next timestep into t, reusing its storage. Returns false at the end of the trace.
+	// Records come with their positions already mapped to cells.
+	virtual bool nextTimestep(Timestep &t) = 0;
+
+	// Makes nextTimestep() throw FCDReadError on a read error instead of ending the program,
+	// for sources read on a thread other than the main one.
+	void throwErrors() { m_throwErrors = true; }
+
+protected:
+	// Reports a read error: throws, or prints it and exits.
+	void readError(const string &message);
+
+private:
+	bool m_throwErrors;
+};
+
+
+/* Streaming reader for SUMO floating car data (FCD) output.
+ * Walks the XML byte stream tag by tag and hands out one Timestep at a time, so memory
+ * is bounded by the largest single timestep instead of the whole trace.
+ *
+ * Expected syntax (--fcd-output.geo=true):
+ * <fcd-export>
+ *  <timestep time="">
+ *   <vehicle id="" x="" y="" speed="" ... />
+ *
+ * gzip, xz and zstd compressed files are recognized by their magic number and
+ * decompressed in memory as they are read.
+ *
+ * Input can also be live (stdin, a named pipe or a socket) while SUMO is still writing it.
+ * A timestep is handed out as soon as its closing tag arrives, nothing is read ahead.
+ */
+class FCDReader : public FCDSource {
+public:
+	// Reads from a file, or from stdin if filename is "-".
+	FCDReader(const string &filename, const FCDFilter &filter = FCDFilter());
+	// Reads from an open file descriptor (e.g. a socket), which the reader closes.
+	FCDReader(int fd, const string &name, const FCDFilter &filter = FCDFilter());
+	// Reads from a stream buffer owned by the caller (e.g. a chunk of a mapped file),
+	// interning vehicle IDs into 'ids' instead of fcdVehicleIDs.
+	FCDReader(streambuf *raw, const string &name, const FCDFilter &filter, VehicleIDTable &ids);
+
+	bool nextTimestep(Timestep &t);
+
+private:
+	string m_filename;
+	FCDFilter m_filter;
+	bool m_finished;			// the stop time was reached
+	ifstream m_file;
+	boost::iostreams::stream_buffer<boost::iostreams::file_descriptor_source> m_fdBuffer;	// stdin and sockets
+	boost::iostreams::filtering_istreambuf m_decompressor;	// set up for compressed files only
+	streambuf *m_buf;			// read one character at a time straight from the (decompressed) stream buffer
+	vector<char> m_readBuffer;	// backing storage for m_file, larger than the default
+	string m_tag;				// contents of the last tag read, between '<' and '>'
+	VehicleIDTable *m_ids;		// where vehicle IDs are interned
+
+	// Reads through raw, decompressing if it holds a compressed file.
+	void attachStream(streambuf *raw);
+
+	// Does the work of nextTimestep(), which reports read errors.
+	bool readTimestep(Timestep &t);
+
+	// Advances to the next tag and stores it in m_tag. Returns false at end of file.
+	bool nextTag();
+
+	// Returns true if the last tag is named 'name' (e.g. "timestep", "/timestep").
+	bool tagIs(const char *name) const;
+
+	// Returns true if the last tag closes itself (<tag ... />).
+	bool tagIsEmpty() const;
+
+	// Finds attribute 'name' on the last tag. Returns false if it isn't there.
+	bool getAttribute(const char *name, string &value) const;
+
+	// Returns attribute 'name' as a number, or 0 if missing or malformed.
+	double getAttributeAsDouble(const char *name) const;
+};
+
+
+/* Binary trace format, written by --convert-fcd and memory-mapped on load.
+ * Layout: header, timestep index, then one column per field for all records in time order.
+ * Columns start on 8-byte boundaries. Values are stored in host byte order.
+ */
+#define FCDBINARY_MAGIC "GSFCDBIN"
+#define FCDBINARY_VERSION 2
+
+struct FCDBinaryHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t timesteps;		// entries in the timestep index
+	uint64_t records;		// entries in each column
+	uint64_t names;			// entries in the ID table
+	uint64_t namesOffset;	// SUMO IDs in slot order, each terminated by '\0'
+	uint64_t indexOffset;	// FCDBinaryIndexEntry[timesteps]
+	uint64_t idOffset;		// uint32_t[records], slots into the ID table
+	uint64_t xOffset;		// float[records]
+	uint64_t yOffset;		// float[records]
+	uint64_t speedOffset;	// float[records]
+};
+
+struct FCDBinaryIndexEntry
+{
+	float time;
+	uint32_t count;		// records in this timestep
+	uint64_t first;		// position of the first record in the columns
+};
+
+
+/* Reads a binary trace through a read-only memory map.
+ * Only the pages of the timesteps actually read are touched.
+ */
+class FCDBinaryReader : public FCDSource {
+public:
+	FCDBinaryReader(const string &filename, const FCDFilter &filter = FCDFilter());
+
+	bool nextTimestep(Timestep &t);
+
+private:
+	boost::iostreams::mapped_file_source m_map;
+	const FCDBinaryHeader *m_header;
+	const FCDBinaryIndexEntry *m_index;
+	const uint32_t *m_id;
+	vector<unsigned int> m_slots;	// file ID table slot -> fcdVehicleIDs slot
+	const float *m_x;
+	const float *m_y;
+	const float *m_speed;
+	uint32_t m_next;	// next timestep to hand out
+	FCDFilter m_filter;
+};
+
+
+/* Decodes timesteps from another source on a reader thread, ahead of the simulation.
+ * Up to 'depth' decoded timesteps wait in a ring of buffers, which are recycled
+ * between the two threads, so ingest overlaps with GIS and network work.
+ */
+class FCDPipeline : public FCDSource {
+public:
+	FCDPipeline(std::unique_ptr<FCDSource> source, unsigned int depth);
+	~FCDPipeline();
+
+	bool nextTimestep(Timestep &t);
+
+private:
+	std::unique_ptr<FCDSource> m_source;
+	vector<Timestep> m_ring;	// decoded timesteps, m_count of them starting at m_head
+	size_t m_head;
+	size_t m_count;
+	bool m_done;				// the source has run out
+	string m_error;				// why the source stopped early, if it did
+	bool m_stop;				// the consumer is gone
+	boost::mutex m_mutex;
+	boost::condition_variable m_changed;
+	boost::thread m_thread;
+
+	// Reader thread body.
+	void produce();
+};
+
+
+/* Hands out timesteps that were read into memory beforehand, releasing each one as it goes.
+ */
+class FCDMemorySource : public FCDSource {
+public:
+	// Takes over the contents of timesteps.
+	FCDMemorySource(vector<Timestep> &timesteps);
+
+	bool nextTimestep(Timestep &t);
+
+private:
+	vector<Timestep> m_timesteps;
+	size_t m_next;	// next timestep to hand out
+};
+
+
+/* Positions between two consecutive FCD timesteps, by linear interpolation of their samples.
+ * Nothing is materialized per substep: a vehicle's position is worked out when it's asked for,
+ * so finer network timing costs no extra input or memory.
+ */
+class TrajectoryInterpolator {
+public:
+	TrajectoryInterpolator() : m_from(NULL), m_to(NULL), m_generation(0) {}
+
+	// Interpolate between these two timesteps, which must stay untouched while in use.
+	void setInterval(const Timestep &from, const Timestep &to);
+
+	// Position of a vehicle (by slot) at a time inside the interval. Vehicles missing from the later
+	// timestep stay where they were. Returns false if the vehicle isn't in the earlier timestep.
+	bool positionAt(unsigned int slot, float time, float &xgeo, float &ygeo) const;
+
+private:
+	// Where a slot's samples are in the two timesteps. Entries from older intervals are told
+	// apart by their generation, so moving on doesn't need to clear the table.
+	struct SlotSamples
+	{
+		uint32_t generation;
+		uint32_t from;
+		uint32_t to;
+	};
+	const Timestep *m_from;
+	const Timestep *m_to;
+	vector<SlotSamples> m_slots;
+	uint32_t m_generation;
+
+	// Returns the entry of a slot, reset if it belongs to an older interval.
+	SlotSamples& samplesOf(unsigned int slot);
+};
+
+
+// Opens an FCD file, XML or binary, detected by its contents. "-" and named pipes are read as live XML.
+// With parseThreads > 1, an uncompressed XML file is read up front by FCD_readParallel().
+std::unique_ptr<FCDSource> FCD_openSource(const string &filename, const FCDFilter &filter = FCDFilter(), unsigned int parseThreads = 0);
+
+/* Reads a whole uncompressed XML file on 'threads' threads. The memory-mapped file is split
+ * at <timestep> tags, each chunk is parsed with an ID table of its own, and the chunks are
+ * stitched back in file order, interning their IDs as the single-threaded reader would.
+ * The result is the same, slot numbers included, but the trace is held in memory.
+ */
+std::unique_ptr<FCDSource> FCD_readParallel(const string &filename, const FCDFilter &filter, unsigned int threads);
+
+// Waits for one TCP connection on localhost:port (e.g. from SUMO --fcd-output localhost:port) and reads live XML from it.
+std::unique_ptr<FCDSource> FCD_openSocket(unsigned short port, const FCDFilter &filter = FCDFilter());
+
+// Returns true if filename is a regular file, which can be mapped and read more than once.
+bool FCD_isRegularFile(const string &filename);
+
+// Returns true if the file starts with the binary trace magic.
+bool FCD_isBinaryFile(const string &filename);
+
+// Reads every timestep from source and writes it out in binary trace format.
+void FCD_writeBinary(FCDSource &source, const string &filename);
+
+#endif /* FCD_H_ */
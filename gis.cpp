@@ -1,144 +1,209 @@
 #include "gis.h"
+#include <iomanip>
 
-void GIS_getPointCoords(pqxx::connection &c, unsigned int gid, float &xgeo, float &ygeo)
+/* Mirrored point writes wait here for the next GIS_syncPoints(), one entry per gid
+ * holding its latest position. New points get their gid straight away from a block
+ * of values reserved from the backend, so nothing has to wait for an INSERT.
+ */
+static vector<GISPoint> pendingPoints;
+static std::unordered_map<unsigned int, size_t> pendingByGID;	// gid -> position in pendingPoints
+static vector<unsigned int> reservedGIDs;
+static boost::mutex pendingMutex;	// guards the above, points may be added from any thread
+
+#define GIDBLOCK 1024	// gids reserved per round trip
+
+// Queues the latest position of a point for the next sync.
+static void queuePoint(unsigned int gid, unsigned int id, float xx, float yy)
+{
+	boost::lock_guard<boost::mutex> lock(pendingMutex);
+	std::pair<std::unordered_map<unsigned int,size_t>::iterator,bool> slot = pendingByGID.insert(std::make_pair(gid, pendingPoints.size()));
+	if(slot.second)
+	{
+		GISPoint point = { gid, id, xx, yy };
+		pendingPoints.push_back(point);
+	}
+	else
+	{
+		pendingPoints[slot.first->second].xgeo = xx;
+		pendingPoints[slot.first->second].ygeo = yy;
+	}
+}
+
+void GIS_getPointCoords(GISBackend &gis, unsigned int gid, float &xgeo, float &ygeo)
 {
-	pqxx::work txn(c);
-	pqxx::result r = txn.exec(
-			"SELECT ST_X(geom),ST_Y(geom) "
-			"FROM edificios "
-			"WHERE gid=" + pqxx::to_string(gid)
-		);
-	txn.commit();
-
-	xgeo = r[0][0].as<float>();
-	ygeo = r[0][1].as<float>();
+	if(!m_postgisRange && gisPoints.coords(gid, xgeo, ygeo))
+		return;
+
+	gis.pointCoords(gid, xgeo, ygeo);
 }
 
 
-vector<unsigned int> GIS_getPointsInRange(pqxx::connection &c, float xcenter, float ycenter, unsigned short range)
+vector<unsigned int> GIS_getPointsInRange(GISBackend &gis, float xcenter, float ycenter, unsigned short range)
 {
 	float wgs84range = range*METERSTODEGREES;
 
-	pqxx::work txn(c);
-	pqxx::result r = txn.exec(
-		"SELECT gid "
-		"FROM edificios "
-		"WHERE ST_DWithin(geom,ST_GeomFromText('POINT("
-			+ pqxx::to_string(xcenter) + " "
-			+ pqxx::to_string(ycenter) + ")',4326)"
-			+ "," + pqxx::to_string(wgs84range) + ")"
-			+ " and feattyp='2222'"
-	);
-	txn.commit();
-
-	vector<unsigned int> neighbors;
-
-	for(pqxx::result::iterator iter=r.begin(); iter != r.end(); iter++)
+	if(!m_postgisRange)
+		return gisPoints.inRange(xcenter, ycenter, wgs84range);
+
+	return gis.pointsInRange(xcenter, ycenter, wgs84range);
+}
+
+vector<GISNeighbor> GIS_getNeighborsInRange(GISBackend &gis, float xcenter, float ycenter, unsigned short range)
+{
+	float wgs84range = range*METERSTODEGREES;
+	vector<GISNeighbor> neighbors;
+
+	if(!m_postgisRange)
 	{
-		neighbors.push_back(iter[0].as<unsigned int>());
+		vector<unsigned int> gids = gisPoints.inRange(xcenter, ycenter, wgs84range);
+		for(vector<unsigned int>::iterator iter=gids.begin(); iter != gids.end(); iter++)
+		{
+			GISNeighbor neighbor;
+			neighbor.gid = *iter;
+			gisPoints.coords(*iter, neighbor.xgeo, neighbor.ygeo);
+			neighbor.distance = GIS_distanceToPointGID(gis, xcenter, ycenter, *iter);
+			neighbor.lineOfSight = GIS_isLineOfSight(gis, xcenter, ycenter, neighbor.xgeo, neighbor.ygeo);
+			neighbors.push_back(neighbor);
+		}
+		return neighbors;
 	}
 
-	return neighbors;
+	if(gisAsync && gisAsync->takeNeighbors(xcenter, ycenter, range, neighbors))
+		return neighbors;
+
+	return gis.neighborsInRange(xcenter, ycenter, wgs84range);
+}
+
+void GIS_prefetchNeighbors(float xcenter, float ycenter, unsigned short range)
+{
+	if(gisAsync && m_postgisRange)
+		gisAsync->prefetchNeighbors(xcenter, ycenter, range);
 }
 
-unsigned short GIS_distanceToPointGID(pqxx::connection &c, float xx, float yy, unsigned int targetgid)
+unsigned short GIS_distanceToPointGID(GISBackend &gis, float xx, float yy, unsigned int targetgid)
 {
-	// first get the target point as WKT
-	pqxx::work txn1(c);
-	pqxx::result r1 = txn1.exec(
-			"SELECT ST_AsText(geom) "
-			"FROM edificios "
-			"WHERE gid=" + pqxx::to_string(targetgid)
-		);
-	txn1.commit();
-
-	std::string targetWKT(r1[0][0].as<string>());
-
-	// now get the distance, convert to meters, and return
-	pqxx::work txn2(c);
-	pqxx::result r2 = txn2.exec(
-		"SELECT ST_Distance('POINT("
-			+ pqxx::to_string(xx) + " "
-			+ pqxx::to_string(yy) + ")', '"
-			+ targetWKT + "')"
-	);
-	txn2.commit();
-
-	return (unsigned short) (r2[0][0].as<float>()/METERSTODEGREES);
+	// planar distance in degrees, as ST_Distance measures it on these geometries
+	float xtarget, ytarget;
+	if(!m_postgisRange && gisPoints.coords(targetgid, xtarget, ytarget))
+	{
+		double dx = (double)xtarget - xx;
+		double dy = (double)ytarget - yy;
+		return (unsigned short) ((float)sqrt(dx*dx + dy*dy)/METERSTODEGREES);
+	}
+
+	// get the distance, convert to meters, and return
+	return (unsigned short) (gis.distanceToPoint(xx, yy, targetgid)/METERSTODEGREES);
 }
 
-bool GIS_isLineOfSight (pqxx::connection &c, float x1, float y1, float x2, float y2)
+bool GIS_isLineOfSight (GISBackend &gis, float x1, float y1, float x2, float y2)
 {
-	pqxx::work txn(c);
-
-	pqxx::result r = txn.exec(
-		"SELECT COUNT(id) "
-		"FROM edificios "
-		"WHERE ST_Intersects(geom, ST_GeomFromText('LINESTRING("
-			+ pqxx::to_string(x1) + " "
-			+ pqxx::to_string(y1) + ","
-			+ pqxx::to_string(x2) + " "
-			+ pqxx::to_string(y2) + ")',4326)) and feattyp='9790'"
-	);
-	txn.commit();
-
-	// return false if line interesects, true otherwise
-	if(r[0][0].as<int>() > 0) return false; else return true;
+	if(gisVisibility.loaded())
+	{
+		// cells are measured off the reference corner in absolute value, see FCDFilter::accepts
+		unsigned short xcell1, ycell1, xcell2, ycell2;
+		determineCellFromWGS84(x1, y1, xcell1, ycell1);
+		determineCellFromWGS84(x2, y2, xcell2, ycell2);
+		if(x1>=XREFERENCE && y1<=YREFERENCE && xcell1<CITYWIDTH && ycell1<CITYHEIGHT
+				&& x2>=XREFERENCE && y2<=YREFERENCE && xcell2<CITYWIDTH && ycell2<CITYHEIGHT)
+			return gisVisibility.lineOfSight(xcell1, ycell1, xcell2, ycell2);
+	}
+
+	if(gisBuildings.loaded())
+		return !gisBuildings.intersects(x1,y1,x2,y2);
+
+	return gis.lineOfSight(x1,y1,x2,y2);
 }
 
-bool GIS_isPointObstructed(pqxx::connection &c, float xx, float yy)
+bool GIS_isPointObstructed(GISBackend &gis, float xx, float yy)
 {
-	pqxx::work txn(c);
-	pqxx::result r = txn.exec(
-		"SELECT COUNT(gid) "
-		"FROM edificios "
-		"WHERE ST_Intersects(geom, ST_GeomFromText('POINT("
-			+ pqxx::to_string(xx) + " "
-			+ pqxx::to_string(yy) + ")',4326))"
-	);
-	txn.commit();
-
-	if(r[0][0].as<int>() > 0) return 1; else return 0;
+	return gis.pointObstructed(xx, yy);
 }
 
-unsigned int GIS_addPoint(pqxx::connection &c, float xx, float yy, unsigned short id)
+// parallelFor() task: tests one trace record.
+static void pointObstructedTask(const vector<TraceRecord> *records, vector<char> *obstructed, GISBackend &gis, size_t i)
 {
-	pqxx::work txnInsert(c);
-	pqxx::result r = txnInsert.exec(
-			"INSERT INTO edificios(id, geom, feattyp) "
-			"VALUES ("
-				+ pqxx::to_string(id)
-				+ ", ST_GeomFromText('POINT("
-				+ pqxx::to_string(xx) + " "
-				+ pqxx::to_string(yy) + ")',4326), 2222) RETURNING gid"
-		);
-	txnInsert.commit();
-
-	return r[0][0].as<unsigned int>();
+	(*obstructed)[i] = GIS_isPointObstructed(gis, (*records)[i].xgeo(), (*records)[i].ygeo());
 }
 
-void GIS_updatePoint(pqxx::connection &c, float xx, float yy, unsigned int gid)
+void GIS_pointsObstructed(GISBackend &gis, const vector<TraceRecord> &records, vector<char> &obstructed)
 {
-	pqxx::work txnUpdate(c);
-	txnUpdate.exec(
-			"UPDATE edificios SET geom=ST_GeomFromText('POINT("
-			+ pqxx::to_string(xx) + " "
-			+ pqxx::to_string(yy) + ")',4326) WHERE gid="
-			+ pqxx::to_string(gid)
-		);
-	txnUpdate.commit();
+	obstructed.assign(records.size(), 0);
+	if(gisPool)
+		gisPool->parallelFor(records.size(), boost::bind(pointObstructedTask, &records, &obstructed, _1, _2));
+	else
+		for(size_t i=0; i<records.size(); i++)
+			pointObstructedTask(&records, &obstructed, gis, i);
 }
 
+unsigned int GIS_addPoint(GISBackend &gis, float xx, float yy, unsigned int id)
+{
+	if(!m_mirrorPoints)
+	{
+		unsigned int gid = gisPoints.newGID();
+		gisPoints.set(gid, xx, yy);
+		if(gisCoverage) gisCoverage->pointMoved(gid, xx, yy);
+		return gid;
+	}
+
+	boost::unique_lock<boost::mutex> lock(pendingMutex);
+	if(reservedGIDs.empty())
+	{
+		// handed out from the back, so reverse to keep them increasing
+		vector<unsigned int> gids = gis.reserveGIDs(GIDBLOCK);
+		reservedGIDs.assign(gids.rbegin(), gids.rend());
+	}
+
+	unsigned int gid = reservedGIDs.back();
+	reservedGIDs.pop_back();
+	lock.unlock();
+	gisPoints.set(gid, xx, yy);
+	if(gisCoverage) gisCoverage->pointMoved(gid, xx, yy);
+	queuePoint(gid, id, xx, yy);
+	return gid;
+}
 
-void GIS_clearAllPoints(pqxx::connection &c)
+void GIS_updatePoint(GISBackend &gis, float xx, float yy, unsigned int gid)
 {
-	pqxx::work txn(c);
-	txn.exec( "DELETE FROM edificios WHERE feattyp='2222'");
-	txn.commit();
+	gisPoints.set(gid, xx, yy);
+	if(gisCoverage) gisCoverage->pointMoved(gid, xx, yy);
+	if(m_mirrorPoints)
+		queuePoint(gid, 0, xx, yy);	// the id is only written for new points
 }
 
 
-void addNewRSU(pqxx::connection &conn, list<RSU> &rsuList, unsigned short id, float xgeo, float ygeo, bool active)
+void GIS_syncPoints(GISBackend &gis)
+{
+	boost::lock_guard<boost::mutex> lock(pendingMutex);
+	if(pendingPoints.empty()) return;
+
+	gis.syncPoints(pendingPoints);
+
+	// points moved, results fetched ahead of time are stale
+	if(gisAsync) gisAsync->discard();
+
+	if(m_debug) cout << "DEBUG GIS_syncPoints wrote " << pendingPoints.size() << " points" << endl;
+	pendingPoints.clear();
+	pendingByGID.clear();
+}
+
+
+void GIS_clearAllPoints(GISBackend &gis)
+{
+	gisPoints.clear();
+	if(gisCoverage) gisCoverage->clear();
+	if(gisAsync) gisAsync->discard();
+	{
+		boost::lock_guard<boost::mutex> lock(pendingMutex);
+		pendingPoints.clear();
+		pendingByGID.clear();
+		reservedGIDs.clear();
+	}
+
+	gis.clearPoints();
+}
+
+
+void addNewRSU(GISBackend &gis, list<RSU> &rsuList, unsigned int id, float xgeo, float ygeo, bool active)
 {
 	RSU testRSU;
 	testRSU.id=id;	// building IDs start on #17779, through #35140
@@ -146,18 +211,18 @@ void addNewRSU(pqxx::connection &conn, list<RSU> &rsuList, unsigned short id, fl
 	testRSU.ygeo=ygeo;
 	testRSU.active=active;
 	// check to see if the RSU is in a valid location
-	if(GIS_isPointObstructed(conn,testRSU.xgeo,testRSU.ygeo))
+	if(GIS_isPointObstructed(gis,testRSU.xgeo,testRSU.ygeo))
 		{ cerr << "ERROR: RSU is inside a building." << endl; exit(1); }
 	// get cell coordinates from WGS84
 	determineCellFromWGS84(testRSU.xgeo,testRSU.ygeo,testRSU.xcell,testRSU.ycell);
 	// add RSU to GIS and get GIS unique id (gid)
-	testRSU.gid = GIS_addPoint(conn,testRSU.xgeo,testRSU.ygeo,testRSU.id);
+	testRSU.gid = GIS_addPoint(gis,testRSU.xgeo,testRSU.ygeo,testRSU.id);
 	// add RSU to list of RSUs
 	rsuList.push_back(testRSU);
 }
 
 
-vector<Vehicle*> getVehiclesInRange(pqxx::connection &conn, list<Vehicle> &vehiclesOnGIS, const RoadObject src)
+vector<Vehicle*> getVehiclesInRange(GISBackend &gis, VehicleList &vehiclesOnGIS, const RoadObject src)
 {
 	/* Step 1: ask GIS for neighbors
 	 * Step 2: match gid to Vehicle objects
@@ -166,35 +231,30 @@ vector<Vehicle*> getVehiclesInRange(pqxx::connection &conn, list<Vehicle> &vehic
 	 * Note that vehiclesOnGIS does not have RSUs.
 	 */
 	vector<Vehicle*> neighbors;
-	vector<unsigned int> GISneighbors;
+	vector<GISNeighbor> GISneighbors;
 
-	// Step 1
-	GISneighbors = GIS_getPointsInRange(conn,src.xgeo,src.ygeo,MAXRANGE);
-	GISneighbors.erase(std::remove(GISneighbors.begin(), GISneighbors.end(), src.gid), GISneighbors.end() ); // drop ourselves from the list
+	// Step 1 (and 3: distance and obstruction come along)
+	GISneighbors = GIS_getNeighborsInRange(gis,src.xgeo,src.ygeo,MAXRANGE);
 
 
 	// Step 2
-	for(vector<unsigned int>::iterator iter=GISneighbors.begin(); iter != GISneighbors.end(); iter++)
+	for(vector<GISNeighbor>::iterator iter=GISneighbors.begin(); iter != GISneighbors.end(); iter++)
 	{
-		// find the vehicle by *iter
-		list<Vehicle>::iterator iterVehicle = find_if(
-				vehiclesOnGIS.begin(),
-				vehiclesOnGIS.end(),
-				boost::bind(&Vehicle::gid, _1) == *iter	// match Vehicle GID with GID from GIS
-				);
+		if(iter->gid == src.gid) continue;	// drop ourselves from the list
 
-		if(iterVehicle != vehiclesOnGIS.end())	// we can get to end() if the neighbor GID was an RSU
+		// find the vehicle by gid
+		Vehicle *iterVehicle = vehiclesOnGIS.byGID(iter->gid);
+
+		if(iterVehicle)	// we get NULL if the neighbor GID was an RSU
 			if(iterVehicle->active)	// we want active neighbors
 			{
 				// Step 3
-				// get the distance, obstruction, and signal to src
-				unsigned short distance = GIS_distanceToPointGID(conn,src.xgeo,src.ygeo,iterVehicle->gid);
-				bool isLineOfSight = GIS_isLineOfSight(conn,src.xgeo,src.ygeo,iterVehicle->xgeo,iterVehicle->ygeo);
-				unsigned short signal = getSignalQuality(distance, isLineOfSight);
+				// get the signal to src
+				unsigned short signal = getSignalQuality(iter->distance, iter->lineOfSight);
 
 				// Step 4
 				if(signal>=2)
-					neighbors.push_back( &(*iterVehicle) ); // an iterator is not a pointer to an object. Dereference and rereference.
+					neighbors.push_back(iterVehicle);
 			}
 	}
 
@@ -211,7 +271,7 @@ vector<Vehicle*> getVehiclesInRange(pqxx::connection &conn, list<Vehicle> &vehic
 	return neighbors;
 }
 
-vector<Vehicle*> getVehiclesNearPoint(pqxx::connection &conn, list<Vehicle> &vehiclesOnGIS, const float xgeo, const float ygeo, const unsigned short range)
+vector<Vehicle*> getVehiclesNearPoint(GISBackend &gis, VehicleList &vehiclesOnGIS, const float xgeo, const float ygeo, const unsigned short range)
 {
 	/* Step 1: ask GIS for neighbors
 	 * Step 2: match gid to Vehicle objects
@@ -221,21 +281,17 @@ vector<Vehicle*> getVehiclesNearPoint(pqxx::connection &conn, list<Vehicle> &veh
 	vector<unsigned int> GISneighbors;
 
 	// Step 1
-	GISneighbors = GIS_getPointsInRange(conn,xgeo,ygeo,range);
+	GISneighbors = GIS_getPointsInRange(gis,xgeo,ygeo,range);
 
 	// Step 2
 	for(vector<unsigned int>::iterator iter=GISneighbors.begin(); iter != GISneighbors.end(); iter++)
 	{
 		// find the vehicle by *iter
-		list<Vehicle>::iterator iterVehicle = find_if(
-				vehiclesOnGIS.begin(),
-				vehiclesOnGIS.end(),
-				boost::bind(&Vehicle::gid, _1) == *iter	// match Vehicle GID with GID from GIS
-				);
+		Vehicle *iterVehicle = vehiclesOnGIS.byGID(*iter);
 
-		if(iterVehicle != vehiclesOnGIS.end())	// we can get to end() if the neighbor GID was an RSU
+		if(iterVehicle)	// we get NULL if the neighbor GID was an RSU
 			if(iterVehicle->active)	// we want active neighbors
-				neighbors.push_back( &(*iterVehicle) ); // an iterator is not a pointer to an object. Dereference and rereference.
+				neighbors.push_back(iterVehicle);
 	}
 
 
@@ -251,7 +307,7 @@ vector<Vehicle*> getVehiclesNearPoint(pqxx::connection &conn, list<Vehicle> &veh
 	return neighbors;
 }
 
-vector<RSU*> getRSUsInRange(pqxx::connection &conn, list<RSU> &rsuList, const RoadObject src)
+vector<RSU*> getRSUsInRange(GISBackend &gis, list<RSU> &rsuList, const RoadObject src)
 {
 	/* Step 1: ask GIS for neighbors
 	 * Step 2: match gid to RSU objects
@@ -259,31 +315,30 @@ vector<RSU*> getRSUsInRange(pqxx::connection &conn, list<RSU> &rsuList, const Ro
 	 * Step 4: trim based on signal strength (<2 drop)
 	 */
 	vector<RSU*> RSUneighbors;
-	vector<unsigned int> GISneighbors;
+	vector<GISNeighbor> GISneighbors;
 
-	// Step 1
-	GISneighbors = GIS_getPointsInRange(conn,src.xgeo,src.ygeo,MAXRANGE);
-	GISneighbors.erase(std::remove(GISneighbors.begin(), GISneighbors.end(), src.gid), GISneighbors.end() ); // drop ourselves from the list
+	// Step 1 (and 3: distance and obstruction come along)
+	GISneighbors = GIS_getNeighborsInRange(gis,src.xgeo,src.ygeo,MAXRANGE);
 
 
 	// Step 2
-	for(vector<unsigned int>::iterator iter=GISneighbors.begin(); iter != GISneighbors.end(); iter++)
+	for(vector<GISNeighbor>::iterator iter=GISneighbors.begin(); iter != GISneighbors.end(); iter++)
 	{
-		// find the vehicle by *iter
+		if(iter->gid == src.gid) continue;	// drop ourselves from the list
+
+		// find the RSU by gid
 		list<RSU>::iterator iterRSU = find_if(
 				rsuList.begin(),
 				rsuList.end(),
-				boost::bind(&RSU::gid, _1) == *iter	// match Vehicle GID with GID from GIS
+				boost::bind(&RSU::gid, _1) == iter->gid	// match RSU GID with GID from GIS
 				);
 
 		if(iterRSU != rsuList.end())	// if it gets to end() then we found no RSUs
 			if(iterRSU->active)	// we want active RSUs only
 			{
 				// Step 3
-				// get the distance, obstruction, and signal to src
-				unsigned short distance = GIS_distanceToPointGID(conn,src.xgeo,src.ygeo,iterRSU->gid);
-				bool isLineOfSight = GIS_isLineOfSight(conn,src.xgeo,src.ygeo,iterRSU->xgeo,iterRSU->ygeo);
-				unsigned short signal = getSignalQuality(distance, isLineOfSight);
+				// get the signal to src
+				unsigned short signal = getSignalQuality(iter->distance, iter->lineOfSight);
 
 				// Step 4
 				if(signal>=2)
@@ -303,3 +358,80 @@ vector<RSU*> getRSUsInRange(pqxx::connection &conn, list<RSU> &rsuList, const Ro
 
 	return RSUneighbors;
 }
+
+
+void updateRSUCoverage(GISBackend &gis, RSU &rsu, bool debug)
+{
+	// first get the RSU's neighbors, with their distance and LOS to the RSU
+	vector<GISNeighbor> rsuNeighs = GIS_getNeighborsInRange(gis,rsu.xgeo,rsu.ygeo,MAXRANGE);
+
+	// now run through each neighbor
+	for(vector<GISNeighbor>::iterator neighbor=rsuNeighs.begin();
+			neighbor != rsuNeighs.end();
+			neighbor++)
+	{
+		// distance from neighbor to RSU
+		unsigned short distneigh = neighbor->distance;
+
+		if(distneigh)	// ignore ourselves (distance==0)
+		{
+			// carry debug
+			if(debug) cout << "DEBUG\t neighbor gid=" << neighbor->gid << " distance " << distneigh << '\n';
+
+			// the neighbor's coordinates
+			float xgeoneigh=neighbor->xgeo, ygeoneigh=neighbor->ygeo;
+			if(debug) cout << "DEBUG\t neighbor gid=" << neighbor->gid << setprecision(8) << " at xgeo=" << xgeoneigh << " ygeo=" << ygeoneigh << '\n';
+
+			// convert them to cells
+			unsigned short xcellneigh=0, ycellneigh=0;
+			determineCellFromWGS84(xgeoneigh,ygeoneigh,xcellneigh,ycellneigh);
+			if(debug) cout << "DEBUG\t neighbor gid=" << neighbor->gid << " cell coords as xcell=" << xcellneigh << "\t ycell=" << ycellneigh << '\n';
+
+			// LOS status
+			bool LOSneigh = neighbor->lineOfSight;
+			if(debug) cout << "DEBUG\t neighbor gid=" << neighbor->gid << " LOS " << (LOSneigh?"true":"false") << '\n';
+
+			// determine signal quality
+			unsigned short signalneigh = getSignalQuality(distneigh,LOSneigh);
+			if(debug) cout << "DEBUG\t neighbor gid=" << neighbor->gid << " signal " << signalneigh << '\n';
+
+			// update RSU coverage map
+			int xrelative = PARKEDCELLRANGE + xcellneigh - rsu.xcell;
+			int yrelative = PARKEDCELLRANGE + ycellneigh - rsu.ycell;
+			// longitude cells are narrower than MAXRANGE, neighbors can fall outside the local map
+			if(xrelative<0 || xrelative>=PARKEDCELLCOVERAGE || yrelative<0 || yrelative>=PARKEDCELLCOVERAGE)
+				continue;
+			rsu.coverage[xrelative][yrelative]=signalneigh;
+			if(debug) cout << "DEBUG\t neighbor gid=" << neighbor->gid << " on RSU map at xcell=" << xrelative << " ycell=" << yrelative << '\n';
+
+		}	// end distance!=0
+	}	// end for(RSU neighbors)
+}
+
+
+// parallelFor() task: updates the coverage of one RSU.
+static void updateRSUCoverageTask(vector<RSU*> *rsus, GISBackend &gis, size_t i)
+{
+	updateRSUCoverage(gis, *(*rsus)[i], false);
+}
+
+void updateRSUCoverages(GISBackend &gis, list<RSU> &rsuList, bool debug)
+{
+	// RSUs don't depend on each other, so with a pool they are spread over its connections
+	// (not while debugging, the output would interleave)
+	if(gisPool && !debug)
+	{
+		vector<RSU*> rsus;
+		for(list<RSU>::iterator iterRSU = rsuList.begin(); iterRSU != rsuList.end(); iterRSU++)
+			rsus.push_back(&(*iterRSU));
+		gisPool->parallelFor(rsus.size(), boost::bind(updateRSUCoverageTask, &rsus, _1, _2));
+		return;
+	}
+
+	// send every RSU's query before waiting on the first
+	for(list<RSU>::iterator iterRSU = rsuList.begin(); iterRSU != rsuList.end(); iterRSU++)
+		GIS_prefetchNeighbors(iterRSU->xgeo, iterRSU->ygeo, MAXRANGE);
+
+	for(list<RSU>::iterator iterRSU = rsuList.begin(); iterRSU != rsuList.end(); iterRSU++)
+		updateRSUCoverage(gis, *iterRSU, debug);
+}
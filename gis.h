@@ -2,42 +2,83 @@
 #define GIS_H_
 
 #include "gissumo.h"
+#include "buildings.h"
+#include "pointgrid.h"
+#include "visibility.h"
+#include "gispool.h"
+#include "gisasync.h"
+#include "gisbackend.h"
+#include "coverage.h"
 extern bool m_debug;
 
+extern bool m_mirrorPoints;		// also write points to the backend, not only to gisPoints
+extern bool m_postgisRange;		// answer range and distance queries from the backend (needs m_mirrorPoints)
+
+/* Vehicles and RSUs (points) live in gisPoints. Range and distance queries are answered
+ * from it unless m_postgisRange is set, and the backend only sees points if m_mirrorPoints is.
+ * Everything that can't be answered in memory goes to the GISBackend passed in.
+ */
+
 // Returns geographic coordinates of a point given its GID.
-void GIS_getPointCoords(pqxx::connection &c, unsigned int gid, float &xgeo, float &ygeo);
+void GIS_getPointCoords(GISBackend &gis, unsigned int gid, float &xgeo, float &ygeo);
 
 // Returns the GIDs of all points in a given range of a given point.
-vector<unsigned int> GIS_getPointsInRange(pqxx::connection &c, float xcenter, float ycenter, unsigned short range);
+vector<unsigned int> GIS_getPointsInRange(GISBackend &gis, float xcenter, float ycenter, unsigned short range);
+
+// Returns every point in range of (xcenter,ycenter), in gid order, with its distance and
+// line of sight to the center. The center itself, if it's a point, comes back at distance 0.
+// From the backend this is a single query.
+vector<GISNeighbor> GIS_getNeighborsInRange(GISBackend &gis, float xcenter, float ycenter, unsigned short range);
+
+// Sends a GIS_getNeighborsInRange() query ahead on gisAsync, if queries go to PostGIS and
+// pipelining is on. The later GIS_getNeighborsInRange() call picks up its result.
+void GIS_prefetchNeighbors(float xcenter, float ycenter, unsigned short range);
 
 // Returns the distance from a set of coordinates to a given point by GID.
-unsigned short GIS_distanceToPointGID(pqxx::connection &c, float xx, float yy, unsigned int targetgid);
+unsigned short GIS_distanceToPointGID(GISBackend &gis, float xx, float yy, unsigned int targetgid);
 
 // Returns false if the path between (x1,y1) and (x2,y2) is obstructed, true otherwise.
-bool GIS_isLineOfSight(pqxx::connection &c, float x1, float y1, float x2, float y2);
+// Answered from gisVisibility for two points on the city map when it's loaded (cell accuracy),
+// then from gisBuildings when it's loaded, from the backend otherwise.
+bool GIS_isLineOfSight(GISBackend &gis, float x1, float y1, float x2, float y2);
 
 // Returns true if the point at (xx,yy) is intersecting with something.
-bool GIS_isPointObstructed(pqxx::connection &c, float xx, float yy);
+bool GIS_isPointObstructed(GISBackend &gis, float xx, float yy);
 
-// Adds a new point to the database. Returns the unique identifier 'gid'. Sets 'feattype' to 2222.
-unsigned int GIS_addPoint(pqxx::connection &c, float xx, float yy, unsigned short id);
+// Runs GIS_isPointObstructed() on every record, in parallel on gisPool when there is one.
+// obstructed[i] is set for records[i].
+void GIS_pointsObstructed(GISBackend &gis, const vector<TraceRecord> &records, vector<char> &obstructed);
 
-// Updates the coordinates of a point via GID.
-void GIS_updatePoint(pqxx::connection &c, float xx, float yy, unsigned int gid);
+// Adds a new point to GIS. Returns the unique identifier 'gid'.
+// Without m_mirrorPoints, the gid comes from gisPoints and nothing is written. With it, the gid
+// is reserved from the backend and the row is written by the next GIS_syncPoints().
+unsigned int GIS_addPoint(GISBackend &gis, float xx, float yy, unsigned int id);
 
-// Removes all POINTs from the database (feattyp 2222).
-void GIS_clearAllPoints(pqxx::connection &c);
+// Updates the coordinates of a point via GID. Mirrored to the backend by the next GIS_syncPoints().
+void GIS_updatePoint(GISBackend &gis, float xx, float yy, unsigned int gid);
 
-// Adds an RSU to the database and GIS.
-void addNewRSU(pqxx::connection &conn, std::list<RSU> &rsuList, unsigned short id, float xgeo, float ygeo, bool active);
+// Writes the points added or moved since the last call to the backend, all in one go.
+void GIS_syncPoints(GISBackend &gis);
+
+// Removes all POINTs from gisPoints and the backend.
+void GIS_clearAllPoints(GISBackend &gis);
+
+// Adds an RSU to GIS.
+void addNewRSU(GISBackend &gis, std::list<RSU> &rsuList, unsigned int id, float xgeo, float ygeo, bool active);
 
 // Returns a list of pointers to vehicles (not RSUs) that we can communicate with.
-vector<Vehicle*> getVehiclesInRange(pqxx::connection &conn, list<Vehicle> &vehiclesOnGIS, const RoadObject src);
+vector<Vehicle*> getVehiclesInRange(GISBackend &gis, VehicleList &vehiclesOnGIS, const RoadObject src);
 
 // Returns a list of pointers to vehicles in a range [range] of [xgeo,ygeo].
-vector<Vehicle*> getVehiclesNearPoint(pqxx::connection &conn, list<Vehicle> &vehiclesOnGIS, const float xgeo, const float ygeo, const unsigned short range);
+vector<Vehicle*> getVehiclesNearPoint(GISBackend &gis, VehicleList &vehiclesOnGIS, const float xgeo, const float ygeo, const unsigned short range);
 
 // Returns a list of pointers to RSUs that we can communicate with.
-vector<RSU*> getRSUsInRange(pqxx::connection &conn, list<RSU> &rsuList, const RoadObject src);
+vector<RSU*> getRSUsInRange(GISBackend &gis, list<RSU> &rsuList, const RoadObject src);
+
+// Rebuilds an RSU's coverage map from the vehicles it sees and their signal quality.
+void updateRSUCoverage(GISBackend &gis, RSU &rsu, bool debug);
+
+// Runs updateRSUCoverage() on every RSU, in parallel on gisPool when there is one and not debugging.
+void updateRSUCoverages(GISBackend &gis, list<RSU> &rsuList, bool debug);
 
 #endif /* GIS_H_ */
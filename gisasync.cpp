@@ -0,0 +1,174 @@
+#include "gisasync.h"
+#include "gis.h"
+
+GISAsyncQueries *gisAsync = NULL;
+
+GISAsyncQueries::GISAsyncQueries(const string &options) : m_nextPending(0)
+{
+	m_conn = PQconnectdb(options.c_str());
+	if(PQstatus(m_conn) != CONNECTION_OK)
+		{ cerr << "ERROR: Could not open pipelined connection: " << PQerrorMessage(m_conn) << endl; exit(1); }
+
+	// same query as gis_neighbors_in_range in PostGISBackend, with types fixed for binary results
+	PGresult *r = PQprepare(m_conn, "gis_async_neighbors",
+		"SELECT p.gid::int4, ST_X(p.geom)::float8, ST_Y(p.geom)::float8, ST_Distance(p.geom,center.geom)::float8, "
+		"NOT EXISTS (SELECT 1 FROM " GIS_BUILDINGSTABLE " b "
+		"WHERE ST_Intersects(b.geom,ST_MakeLine(center.geom,p.geom))) "
+		"FROM " GIS_POINTSTABLE " p, (SELECT ST_SetSRID(ST_MakePoint($1::float8,$2::float8),4326) AS geom) center "
+		"WHERE ST_DWithin(p.geom,center.geom,$3::float8) "
+		"ORDER BY p.gid", 3, NULL);
+	if(PQresultStatus(r) != PGRES_COMMAND_OK)
+		{ cerr << "ERROR: Could not prepare pipelined query: " << PQerrorMessage(m_conn) << endl; exit(1); }
+	PQclear(r);
+
+	if(!PQenterPipelineMode(m_conn) || PQsetnonblocking(m_conn, 1))
+		{ cerr << "ERROR: Could not enter pipeline mode: " << PQerrorMessage(m_conn) << endl; exit(1); }
+
+	if(m_debug) cout << "DEBUG Opened pipelined GIS connection" << endl;
+}
+
+
+GISAsyncQueries::~GISAsyncQueries()
+{
+	discard();
+	PQfinish(m_conn);
+}
+
+
+void GISAsyncQueries::flush()
+{
+	int pending;
+	while( (pending=PQflush(m_conn)) == 1 )
+	{
+		pollfd socket = { PQsocket(m_conn), POLLIN | POLLOUT, 0 };
+		poll(&socket, 1, -1);
+		if((socket.revents & POLLIN) && !PQconsumeInput(m_conn)) break;
+	}
+	if(pending < 0)
+		{ cerr << "ERROR: Could not send pipelined query: " << PQerrorMessage(m_conn) << endl; exit(1); }
+}
+
+
+PGresult* GISAsyncQueries::nextResult()
+{
+	while(PQisBusy(m_conn))
+	{
+		pollfd socket = { PQsocket(m_conn), POLLIN, 0 };
+		poll(&socket, 1, -1);
+		if(!PQconsumeInput(m_conn))
+			{ cerr << "ERROR: Lost pipelined connection: " << PQerrorMessage(m_conn) << endl; exit(1); }
+	}
+	return PQgetResult(m_conn);
+}
+
+
+// Big-endian binary field readers.
+static uint32_t binaryInt4(const PGresult *r, int row, int column)
+{
+	uint32_t value;
+	memcpy(&value, PQgetvalue(r, row, column), sizeof(value));
+	return be32toh(value);
+}
+
+static double binaryFloat8(const PGresult *r, int row, int column)
+{
+	uint64_t bits;
+	double value;
+	memcpy(&bits, PQgetvalue(r, row, column), sizeof(bits));
+	bits = be64toh(bits);
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+
+void GISAsyncQueries::readPending()
+{
+	Query &query = *m_pending[m_nextPending++];
+
+	// each query was sent with its own sync: its result, the end of it, then the sync
+	PGresult *r = nextResult();
+	if(PQresultStatus(r) != PGRES_TUPLES_OK)
+		{ cerr << "ERROR: Pipelined query failed: " << PQresultErrorMessage(r) << endl; exit(1); }
+
+	for(int row=0; row<PQntuples(r); row++)
+	{
+		GISNeighbor neighbor;
+		neighbor.gid = binaryInt4(r, row, 0);
+		neighbor.xgeo = binaryFloat8(r, row, 1);
+		neighbor.ygeo = binaryFloat8(r, row, 2);
+		neighbor.distance = (unsigned short) ((float)binaryFloat8(r, row, 3)/METERSTODEGREES);
+		neighbor.lineOfSight = *PQgetvalue(r, row, 4) != 0;
+		query.neighbors.push_back(neighbor);
+	}
+	PQclear(r);
+
+	if( (r=nextResult()) ) PQclear(r);
+	r = nextResult();
+	if(PQresultStatus(r) != PGRES_PIPELINE_SYNC)
+		{ cerr << "ERROR: Pipelined query out of step: " << PQresStatus(PQresultStatus(r)) << endl; exit(1); }
+	PQclear(r);
+
+	query.done = true;
+	if(m_nextPending == m_pending.size())
+	{
+		m_pending.clear();
+		m_nextPending = 0;
+	}
+}
+
+
+void GISAsyncQueries::prefetchNeighbors(float xcenter, float ycenter, unsigned short range)
+{
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+
+	QueryKey key = { xcenter, ycenter, range };
+	std::pair<std::map<QueryKey,Query>::iterator,bool> slot = m_queries.insert(std::make_pair(key, Query()));
+	if(!slot.second) return;
+	slot.first->second.done = false;
+
+	// float8 parameters in network byte order
+	double values[3] = { xcenter, ycenter, range*METERSTODEGREES };
+	uint64_t params[3];
+	const char *paramValues[3];
+	int paramLengths[3], paramFormats[3];
+	for(int param=0; param<3; param++)
+	{
+		memcpy(&params[param], &values[param], sizeof(double));
+		params[param] = htobe64(params[param]);
+		paramValues[param] = reinterpret_cast<const char*>(&params[param]);
+		paramLengths[param] = sizeof(double);
+		paramFormats[param] = 1;
+	}
+
+	if(!PQsendQueryPrepared(m_conn, "gis_async_neighbors", 3, paramValues, paramLengths, paramFormats, 1) || !PQpipelineSync(m_conn))
+		{ cerr << "ERROR: Could not queue pipelined query: " << PQerrorMessage(m_conn) << endl; exit(1); }
+	flush();
+
+	m_pending.push_back(&slot.first->second);
+}
+
+
+bool GISAsyncQueries::takeNeighbors(float xcenter, float ycenter, unsigned short range, vector<GISNeighbor> &neighbors)
+{
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+
+	QueryKey key = { xcenter, ycenter, range };
+	std::map<QueryKey,Query>::iterator query = m_queries.find(key);
+	if(query == m_queries.end()) return false;
+
+	// results come back in order, so read up to this one
+	while(!query->second.done)
+		readPending();
+
+	neighbors = query->second.neighbors;
+	return true;
+}
+
+
+void GISAsyncQueries::discard()
+{
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+	while(m_nextPending < m_pending.size())
+		readPending();
+	m_queries.clear();
+}
@@ -0,0 +1,76 @@
+#ifndef GISASYNC_H_
+#define GISASYNC_H_
+
+#include <map>
+#include <poll.h>
+#include <endian.h>
+#include <libpq-fe.h>
+#include <boost/thread/mutex.hpp>
+#include "gissumo.h"
+extern bool m_debug;
+
+struct GISNeighbor;
+
+
+/* Neighbor queries sent ahead of time over a libpq connection in pipeline mode.
+ * Callers submit the queries they will need soon and carry on; the server works
+ * through them back to back, and each result is read when it's asked for, so the
+ * round trips overlap instead of adding up. Parameters and results travel in binary.
+ *
+ * Results are kept, keyed by the query's center and range, until discard(), which
+ * has to be called whenever the points in the database move.
+ */
+class GISAsyncQueries {
+public:
+	// Opens its own connection with the given libpq connection string.
+	GISAsyncQueries(const string &options);
+	~GISAsyncQueries();
+
+	// Sends a GIS_getNeighborsInRange() query, unless the same one was sent already.
+	void prefetchNeighbors(float xcenter, float ycenter, unsigned short range);
+
+	// Gets the result of a prefetched query, waiting for it if needed.
+	// Returns false if it was never prefetched.
+	bool takeNeighbors(float xcenter, float ycenter, unsigned short range, vector<GISNeighbor> &neighbors);
+
+	// Drops all results, reading past the ones still on their way.
+	void discard();
+
+private:
+	struct QueryKey
+	{
+		float xcenter, ycenter;
+		unsigned short range;
+		bool operator<(const QueryKey &other) const
+		{
+			if(xcenter != other.xcenter) return xcenter < other.xcenter;
+			if(ycenter != other.ycenter) return ycenter < other.ycenter;
+			return range < other.range;
+		}
+	};
+	struct Query
+	{
+		bool done;
+		vector<GISNeighbor> neighbors;
+	};
+
+	PGconn *m_conn;
+	std::map<QueryKey,Query> m_queries;
+	vector<Query*> m_pending;	// sent but not read yet, in the order the results will arrive
+	size_t m_nextPending;
+	boost::mutex m_mutex;
+
+	// Pushes queued output to the server, reading input meanwhile so neither side stalls.
+	void flush();
+
+	// Returns the next result, waiting for it to arrive.
+	PGresult* nextResult();
+
+	// Reads the results of the oldest pending query into it.
+	void readPending();
+};
+
+// Pipelined connection used by GIS_getNeighborsInRange() and GIS_prefetchNeighbors(), NULL if off.
+extern GISAsyncQueries *gisAsync;
+
+#endif /* GISASYNC_H_ */
@@ -0,0 +1,227 @@
+#include "gisbackend.h"
+
+PostGISBackend::PostGISBackend(const string &options, bool createTables)
+	: m_conn(options)
+{
+	if(createTables) this->createTables();
+	prepareStatements();
+}
+
+
+void PostGISBackend::createTables()
+{
+	/* Points move every timestep. In a table of their own, unlogged (no WAL) and with a
+	 * GiST index of their own, their updates don't churn the buildings' index, and
+	 * clearing them is a TRUNCATE. Unlogged rather than temporary so that every pooled
+	 * connection sees the same points.
+	 * The buildings are a materialized copy of the feattyp 9790 rows, so line of sight
+	 * only ever searches buildings. Refresh it if the shapefile data changes.
+	 */
+	pqxx::work txn(m_conn);
+	txn.exec(
+		"CREATE UNLOGGED TABLE IF NOT EXISTS " GIS_POINTSTABLE " "
+		"(gid serial PRIMARY KEY, id integer, geom geometry(Point,4326))"
+	);
+	txn.exec("CREATE INDEX IF NOT EXISTS " GIS_POINTSTABLE "_geom ON " GIS_POINTSTABLE " USING GIST (geom)");
+	txn.exec(
+		"CREATE MATERIALIZED VIEW IF NOT EXISTS " GIS_BUILDINGSTABLE " AS "
+		"SELECT gid, id, geom FROM " GIS_FEATURESTABLE " WHERE feattyp='9790'"
+	);
+	txn.exec("CREATE INDEX IF NOT EXISTS " GIS_BUILDINGSTABLE "_geom ON " GIS_BUILDINGSTABLE " USING GIST (geom)");
+	txn.commit();
+}
+
+
+void PostGISBackend::prepareStatements()
+{
+	/* Coordinates are bound as float8 parameters, so none of these is parsed or planned
+	 * again per call, and no precision is lost printing them into the query text.
+	 * Geometries are built with ST_MakePoint instead of parsing WKT.
+	 */
+	m_conn.prepare("gis_point_coords",
+		"SELECT ST_X(geom),ST_Y(geom) FROM " GIS_POINTSTABLE " WHERE gid=$1::integer");
+	m_conn.prepare("gis_points_in_range",
+		"SELECT gid FROM " GIS_POINTSTABLE " "
+		"WHERE ST_DWithin(geom,ST_SetSRID(ST_MakePoint($1::float8,$2::float8),4326),$3::float8)");
+	m_conn.prepare("gis_neighbors_in_range",
+		"SELECT p.gid, ST_X(p.geom), ST_Y(p.geom), ST_Distance(p.geom,center.geom), "
+		"NOT EXISTS (SELECT 1 FROM " GIS_BUILDINGSTABLE " b "
+		"WHERE ST_Intersects(b.geom,ST_MakeLine(center.geom,p.geom))) "
+		"FROM " GIS_POINTSTABLE " p, (SELECT ST_SetSRID(ST_MakePoint($1::float8,$2::float8),4326) AS geom) center "
+		"WHERE ST_DWithin(p.geom,center.geom,$3::float8) "
+		"ORDER BY p.gid");
+	m_conn.prepare("gis_distance_to_point",
+		"SELECT ST_Distance(ST_SetSRID(ST_MakePoint($1::float8,$2::float8),4326),geom) "
+		"FROM " GIS_POINTSTABLE " WHERE gid=$3::integer");
+	m_conn.prepare("gis_line_of_sight",
+		"SELECT COUNT(id) FROM " GIS_BUILDINGSTABLE " "
+		"WHERE ST_Intersects(geom,ST_SetSRID(ST_MakeLine(ST_MakePoint($1::float8,$2::float8),"
+		"ST_MakePoint($3::float8,$4::float8)),4326))");
+	m_conn.prepare("gis_point_obstructed",
+		"SELECT COUNT(gid) FROM " GIS_FEATURESTABLE " "
+		"WHERE ST_Intersects(geom,ST_SetSRID(ST_MakePoint($1::float8,$2::float8),4326))");
+	m_conn.prepare("gis_reserve_gids",
+		"SELECT nextval(pg_get_serial_sequence('" GIS_POINTSTABLE "','gid')) FROM generate_series(1,$1::integer)");
+	m_conn.prepare("gis_clear_points",
+		"TRUNCATE " GIS_POINTSTABLE);
+
+	// the staging table for syncPoints() lives as long as the connection
+	pqxx::work txn(m_conn);
+	txn.exec(
+		"CREATE TEMP TABLE gissumo_staging "
+		"(gid integer, id integer, x double precision, y double precision) "
+		"ON COMMIT DELETE ROWS"
+	);
+	txn.commit();
+	m_conn.prepare("gis_sync_points",
+		"INSERT INTO " GIS_POINTSTABLE "(gid, id, geom) "
+		"SELECT gid, id, ST_SetSRID(ST_MakePoint(x,y),4326) FROM gissumo_staging "
+		"ON CONFLICT (gid) DO UPDATE SET geom=EXCLUDED.geom");
+}
+
+
+void PostGISBackend::pointCoords(unsigned int gid, float &xgeo, float &ygeo)
+{
+	pqxx::work txn(m_conn);
+	pqxx::result r = txn.prepared("gis_point_coords")(gid).exec();
+	txn.commit();
+
+	xgeo = r[0][0].as<float>();
+	ygeo = r[0][1].as<float>();
+}
+
+
+vector<unsigned int> PostGISBackend::pointsInRange(float xcenter, float ycenter, float wgs84range)
+{
+	pqxx::work txn(m_conn);
+	pqxx::result r = txn.prepared("gis_points_in_range")((double)xcenter)((double)ycenter)((double)wgs84range).exec();
+	txn.commit();
+
+	vector<unsigned int> neighbors;
+
+	for(pqxx::result::iterator iter=r.begin(); iter != r.end(); iter++)
+	{
+		neighbors.push_back(iter[0].as<unsigned int>());
+	}
+
+	return neighbors;
+}
+
+
+vector<GISNeighbor> PostGISBackend::neighborsInRange(float xcenter, float ycenter, float wgs84range)
+{
+	// range, coordinates, distance and obstruction all in one round trip
+	pqxx::work txn(m_conn);
+	pqxx::result r = txn.prepared("gis_neighbors_in_range")((double)xcenter)((double)ycenter)((double)wgs84range).exec();
+	txn.commit();
+
+	vector<GISNeighbor> neighbors;
+
+	for(pqxx::result::iterator iter=r.begin(); iter != r.end(); iter++)
+	{
+		GISNeighbor neighbor;
+		neighbor.gid = iter[0].as<unsigned int>();
+		neighbor.xgeo = iter[1].as<float>();
+		neighbor.ygeo = iter[2].as<float>();
+		neighbor.distance = (unsigned short) (iter[3].as<float>()/METERSTODEGREES);
+		neighbor.lineOfSight = iter[4].as<bool>();
+		neighbors.push_back(neighbor);
+	}
+	return neighbors;
+}
+
+
+float PostGISBackend::distanceToPoint(float xx, float yy, unsigned int gid)
+{
+	pqxx::work txn(m_conn);
+	pqxx::result r = txn.prepared("gis_distance_to_point")((double)xx)((double)yy)(gid).exec();
+	txn.commit();
+
+	return r[0][0].as<float>();
+}
+
+
+bool PostGISBackend::lineOfSight(float x1, float y1, float x2, float y2)
+{
+	pqxx::work txn(m_conn);
+	pqxx::result r = txn.prepared("gis_line_of_sight")((double)x1)((double)y1)((double)x2)((double)y2).exec();
+	txn.commit();
+
+	// return false if line interesects, true otherwise
+	if(r[0][0].as<int>() > 0) return false; else return true;
+}
+
+
+bool PostGISBackend::pointObstructed(float xx, float yy)
+{
+	pqxx::work txn(m_conn);
+	pqxx::result r = txn.prepared("gis_point_obstructed")((double)xx)((double)yy).exec();
+	txn.commit();
+
+	if(r[0][0].as<int>() > 0) return 1; else return 0;
+}
+
+
+vector<string> PostGISBackend::buildingPolygons()
+{
+	pqxx::work txn(m_conn);
+	pqxx::result r = txn.exec(
+		"SELECT ST_AsText(part) "
+		"FROM (SELECT (ST_Dump(ST_Force2D(geom))).geom AS part "
+		"FROM " GIS_BUILDINGSTABLE ") AS parts "
+		"WHERE GeometryType(part)='POLYGON'"
+	);
+	txn.commit();
+
+	vector<string> polygons;
+	polygons.reserve(r.size());
+	for(pqxx::result::iterator iter=r.begin(); iter != r.end(); iter++)
+		polygons.push_back(iter[0].as<string>());
+	return polygons;
+}
+
+
+vector<unsigned int> PostGISBackend::reserveGIDs(unsigned int count)
+{
+	pqxx::work txn(m_conn);
+	pqxx::result r = txn.prepared("gis_reserve_gids")(count).exec();
+	txn.commit();
+
+	vector<unsigned int> gids;
+	for(pqxx::result::iterator iter=r.begin(); iter != r.end(); iter++)
+		gids.push_back(iter[0].as<unsigned int>());
+	return gids;
+}
+
+
+void PostGISBackend::syncPoints(const vector<GISPoint> &points)
+{
+	pqxx::work txn(m_conn);
+
+	// COPY the whole timestep in one stream, coordinates written out in full
+	{
+		pqxx::tablewriter staging(txn, "gissumo_staging");
+		vector<string> row(4);
+		for(vector<GISPoint>::const_iterator iter=points.begin(); iter != points.end(); iter++)
+		{
+			row[0] = pqxx::to_string(iter->gid);
+			row[1] = pqxx::to_string(iter->id);
+			row[2] = pqxx::to_string((double)iter->xgeo);
+			row[3] = pqxx::to_string((double)iter->ygeo);
+			staging << row;
+		}
+		staging.complete();
+	}
+
+	// new gids are inserted, known ones only have their position moved
+	txn.prepared("gis_sync_points").exec();
+	txn.commit();
+}
+
+
+void PostGISBackend::clearPoints()
+{
+	pqxx::work txn(m_conn);
+	txn.prepared("gis_clear_points").exec();
+	txn.commit();
+}
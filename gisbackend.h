@@ -0,0 +1,99 @@
+#ifndef GISBACKEND_H_
+#define GISBACKEND_H_
+
+#include "gissumo.h"
+extern bool m_debug;
+
+// Relations used in PostGIS: the shapefile features, buildings only, and the vehicle and RSU points.
+#define GIS_FEATURESTABLE "edificios"
+#define GIS_BUILDINGSTABLE "gissumo_buildings"
+#define GIS_POINTSTABLE "gissumo_points"
+
+
+// A point as written to the backend by GIS_syncPoints().
+struct GISPoint
+{
+	unsigned int gid;
+	unsigned int id;
+	float xgeo, ygeo;
+};
+
+// A point found by a neighbor query, with everything needed to work out its signal.
+struct GISNeighbor
+{
+	unsigned int gid;
+	float xgeo, ygeo;
+	unsigned short distance;	// meters
+	bool lineOfSight;
+};
+
+
+/* Whatever answers the spatial queries the simulator can't answer from memory.
+ * The GIS_* functions in gis.h do their in-memory work first and come here for the
+ * rest, so a backend only sees raw queries: coordinates and ranges in degrees.
+ * Query methods may be called on different instances from several threads at once
+ * (see GISConnectionPool), points are only written from the main thread.
+ */
+class GISBackend {
+public:
+	virtual ~GISBackend() {}
+
+	// Returns the coordinates of a point.
+	virtual void pointCoords(unsigned int gid, float &xgeo, float &ygeo) = 0;
+
+	// Returns the gids of all points within wgs84range of (xcenter,ycenter).
+	virtual vector<unsigned int> pointsInRange(float xcenter, float ycenter, float wgs84range) = 0;
+
+	// Returns all points within wgs84range of (xcenter,ycenter) in gid order, with distance and line of sight.
+	virtual vector<GISNeighbor> neighborsInRange(float xcenter, float ycenter, float wgs84range) = 0;
+
+	// Returns the planar distance in degrees from (xx,yy) to a point.
+	virtual float distanceToPoint(float xx, float yy, unsigned int gid) = 0;
+
+	// Returns true if no building crosses the segment (x1,y1)-(x2,y2).
+	virtual bool lineOfSight(float x1, float y1, float x2, float y2) = 0;
+
+	// Returns true if (xx,yy) is inside any feature.
+	virtual bool pointObstructed(float xx, float yy) = 0;
+
+	// Returns every building polygon as WKT, multipolygons split into their parts.
+	virtual vector<string> buildingPolygons() = 0;
+
+	// Reserves 'count' new point gids, in increasing order.
+	virtual vector<unsigned int> reserveGIDs(unsigned int count) = 0;
+
+	// Inserts new points and moves known ones.
+	virtual void syncPoints(const vector<GISPoint> &points) = 0;
+
+	// Removes all points.
+	virtual void clearPoints() = 0;
+};
+
+
+/* The PostGIS backend, on a connection of its own.
+ */
+class PostGISBackend : public GISBackend {
+public:
+	// Connects with the given libpq connection string and prepares the statements.
+	// With createTables, first creates the points table and buildings relation if they don't exist.
+	PostGISBackend(const string &options, bool createTables);
+
+	virtual void pointCoords(unsigned int gid, float &xgeo, float &ygeo);
+	virtual vector<unsigned int> pointsInRange(float xcenter, float ycenter, float wgs84range);
+	virtual vector<GISNeighbor> neighborsInRange(float xcenter, float ycenter, float wgs84range);
+	virtual float distanceToPoint(float xx, float yy, unsigned int gid);
+	virtual bool lineOfSight(float x1, float y1, float x2, float y2);
+	virtual bool pointObstructed(float xx, float yy);
+	virtual vector<string> buildingPolygons();
+	virtual vector<unsigned int> reserveGIDs(unsigned int count);
+	virtual void syncPoints(const vector<GISPoint> &points);
+	virtual void clearPoints();
+
+private:
+	pqxx::connection m_conn;
+
+	void createTables();
+	void prepareStatements();
+};
+
+#endif /* GISBACKEND_H_ */
@@ -0,0 +1,62 @@
+#include "gispool.h"
+#include "gis.h"
+
+GISConnectionPool *gisPool = NULL;
+
+GISConnectionPool::GISConnectionPool(const boost::function<GISBackend* ()> &open, unsigned int size)
+{
+	for(unsigned int conn=0; conn<size; conn++)
+		m_backends.push_back(open());
+	m_free = m_backends;
+
+	if(m_debug) cout << "DEBUG Opened " << size << " GIS backends" << endl;
+}
+
+
+GISConnectionPool::~GISConnectionPool()
+{
+	for(vector<GISBackend*>::iterator iter=m_backends.begin(); iter != m_backends.end(); iter++)
+		delete *iter;
+}
+
+
+GISBackend& GISConnectionPool::acquire()
+{
+	boost::unique_lock<boost::mutex> lock(m_mutex);
+	while(m_free.empty())
+		m_released.wait(lock);
+
+	GISBackend *gis = m_free.back();
+	m_free.pop_back();
+	return *gis;
+}
+
+
+void GISConnectionPool::release(GISBackend &gis)
+{
+	{
+		boost::lock_guard<boost::mutex> lock(m_mutex);
+		m_free.push_back(&gis);
+	}
+	m_released.notify_one();
+}
+
+
+void GISConnectionPool::runStride(const boost::function<void (GISBackend&, size_t)> *task, size_t count, size_t first, size_t step)
+{
+	GISBackend &gis = acquire();
+	for(size_t i=first; i<count; i+=step)
+		(*task)(gis, i);
+	release(gis);
+}
+
+
+void GISConnectionPool::parallelFor(size_t count, const boost::function<void (GISBackend&, size_t)> &task)
+{
+	size_t threads = min((size_t) m_backends.size(), count);
+
+	boost::thread_group workers;
+	for(size_t thread=0; thread<threads; thread++)
+		workers.create_thread(boost::bind(&GISConnectionPool::runStride, this, &task, count, thread, threads));
+	workers.join_all();
+}
@@ -0,0 +1,48 @@
+#ifndef GISPOOL_H_
+#define GISPOOL_H_
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "gissumo.h"
+#include "gisbackend.h"
+extern bool m_debug;
+
+
+/* A fixed set of GIS backends, each on a database connection of its own (or replaying a recording), for
+ * running independent GIS work on several threads at once. The GIS_* functions and
+ * the neighbor lookups built on them may be called concurrently on different
+ * backends, as long as no thread is adding or moving points at the same time.
+ */
+class GISConnectionPool {
+public:
+	// Opens 'size' backends by calling open().
+	GISConnectionPool(const boost::function<GISBackend* ()> &open, unsigned int size);
+	~GISConnectionPool();
+
+	unsigned int size() const { return m_backends.size(); }
+
+	// Takes a backend for the calling thread, waiting for one to be free.
+	GISBackend& acquire();
+
+	// Gives a backend back.
+	void release(GISBackend &gis);
+
+	// Runs task(backend, i) for every i in [0,count), on one thread per backend,
+	// and returns when all are done.
+	void parallelFor(size_t count, const boost::function<void (GISBackend&, size_t)> &task);
+
+private:
+	vector<GISBackend*> m_backends;
+	vector<GISBackend*> m_free;
+	boost::mutex m_mutex;
+	boost::condition_variable m_released;
+
+	// Worker body for parallelFor(): indexes first, first+step, ...
+	void runStride(const boost::function<void (GISBackend&, size_t)> *task, size_t count, size_t first, size_t step);
+};
+
+// Backends for parallel GIS work, NULL if there's only the main one.
+extern GISConnectionPool *gisPool;
+
+#endif /* GISPOOL_H_ */
@@ -0,0 +1,409 @@
+#include "gisrecord.h"
+
+#define GISLOG_MAGIC "GSGISLOG"
+#define GISLOG_VERSION 1
+
+// Query types, the first byte of every query.
+enum GISQueryType
+{
+	GISQ_POINTCOORDS = 1,
+	GISQ_POINTSINRANGE,
+	GISQ_NEIGHBORSINRANGE,
+	GISQ_DISTANCETOPOINT,
+	GISQ_LINEOFSIGHT,
+	GISQ_POINTOBSTRUCTED,
+	GISQ_BUILDINGPOLYGONS,
+	GISQ_RESERVEGIDS
+};
+
+static const char *queryNames[] = { "", "point coordinates", "points in range", "neighbors in range",
+		"distance to point", "line of sight", "point obstructed", "building polygons", "gid reservation" };
+
+
+/* Encoding
+   -------- */
+
+// Appends the raw bytes of a value.
+template<typename T> static void put(string &bytes, const T &value)
+{
+	bytes.append((const char*) &value, sizeof(T));
+}
+
+// Reads values back in the order put() wrote them.
+class ByteReader {
+public:
+	ByteReader(const string &bytes) : m_bytes(bytes), m_pos(0) {}
+
+	template<typename T> T get()
+	{
+		T value;
+		if(m_pos+sizeof(T) > m_bytes.size())
+			{ cerr << "ERROR: GIS recording entry is truncated" << endl; exit(1); }
+		memcpy(&value, m_bytes.data()+m_pos, sizeof(T));
+		m_pos += sizeof(T);
+		return value;
+	}
+
+	string getString(size_t length)
+	{
+		if(m_pos+length > m_bytes.size())
+			{ cerr << "ERROR: GIS recording entry is truncated" << endl; exit(1); }
+		string value = m_bytes.substr(m_pos, length);
+		m_pos += length;
+		return value;
+	}
+
+private:
+	const string &m_bytes;
+	size_t m_pos;
+};
+
+// Starts a query of a given type.
+static string newQuery(unsigned char type)
+{
+	return string(1, (char) type);
+}
+
+static string encodeGIDs(const vector<unsigned int> &gids)
+{
+	string bytes;
+	put(bytes, (uint32_t) gids.size());
+	for(vector<unsigned int>::const_iterator iter=gids.begin(); iter != gids.end(); iter++)
+		put(bytes, (uint32_t) *iter);
+	return bytes;
+}
+
+static vector<unsigned int> decodeGIDs(const string &bytes)
+{
+	ByteReader reader(bytes);
+	vector<unsigned int> gids(reader.get<uint32_t>());
+	for(vector<unsigned int>::iterator iter=gids.begin(); iter != gids.end(); iter++)
+		*iter = reader.get<uint32_t>();
+	return gids;
+}
+
+static string encodeNeighbors(const vector<GISNeighbor> &neighbors)
+{
+	string bytes;
+	put(bytes, (uint32_t) neighbors.size());
+	for(vector<GISNeighbor>::const_iterator iter=neighbors.begin(); iter != neighbors.end(); iter++)
+	{
+		put(bytes, (uint32_t) iter->gid);
+		put(bytes, iter->xgeo);
+		put(bytes, iter->ygeo);
+		put(bytes, (uint16_t) iter->distance);
+		put(bytes, (uint8_t) iter->lineOfSight);
+	}
+	return bytes;
+}
+
+static vector<GISNeighbor> decodeNeighbors(const string &bytes)
+{
+	ByteReader reader(bytes);
+	vector<GISNeighbor> neighbors(reader.get<uint32_t>());
+	for(vector<GISNeighbor>::iterator iter=neighbors.begin(); iter != neighbors.end(); iter++)
+	{
+		iter->gid = reader.get<uint32_t>();
+		iter->xgeo = reader.get<float>();
+		iter->ygeo = reader.get<float>();
+		iter->distance = reader.get<uint16_t>();
+		iter->lineOfSight = reader.get<uint8_t>();
+	}
+	return neighbors;
+}
+
+static string encodeStrings(const vector<string> &strings)
+{
+	string bytes;
+	put(bytes, (uint32_t) strings.size());
+	for(vector<string>::const_iterator iter=strings.begin(); iter != strings.end(); iter++)
+	{
+		put(bytes, (uint32_t) iter->size());
+		bytes += *iter;
+	}
+	return bytes;
+}
+
+static vector<string> decodeStrings(const string &bytes)
+{
+	ByteReader reader(bytes);
+	vector<string> strings(reader.get<uint32_t>());
+	for(vector<string>::iterator iter=strings.begin(); iter != strings.end(); iter++)
+		*iter = reader.getString(reader.get<uint32_t>());
+	return strings;
+}
+
+// The queries themselves, shared by recording and replay so both build identical keys.
+static string queryPointCoords(GISQueryLog &log, unsigned int gid)
+{
+	string query = newQuery(GISQ_POINTCOORDS);
+	put(query, (uint32_t) log.pointsVersion());
+	put(query, (uint32_t) gid);
+	return query;
+}
+
+static string queryInRange(unsigned char type, GISQueryLog &log, float xcenter, float ycenter, float wgs84range)
+{
+	string query = newQuery(type);
+	put(query, (uint32_t) log.pointsVersion());
+	put(query, xcenter);
+	put(query, ycenter);
+	put(query, wgs84range);
+	return query;
+}
+
+static string queryDistanceToPoint(GISQueryLog &log, float xx, float yy, unsigned int gid)
+{
+	string query = newQuery(GISQ_DISTANCETOPOINT);
+	put(query, (uint32_t) log.pointsVersion());
+	put(query, xx);
+	put(query, yy);
+	put(query, (uint32_t) gid);
+	return query;
+}
+
+static string queryLineOfSight(float x1, float y1, float x2, float y2)
+{
+	string query = newQuery(GISQ_LINEOFSIGHT);
+	put(query, x1);
+	put(query, y1);
+	put(query, x2);
+	put(query, y2);
+	return query;
+}
+
+static string queryPointObstructed(float xx, float yy)
+{
+	string query = newQuery(GISQ_POINTOBSTRUCTED);
+	put(query, xx);
+	put(query, yy);
+	return query;
+}
+
+static string queryReserveGIDs(GISQueryLog &log, unsigned int count)
+{
+	string query = newQuery(GISQ_RESERVEGIDS);
+	put(query, (uint32_t) log.nextReserveCall());
+	put(query, (uint32_t) count);
+	return query;
+}
+
+
+/* GISRecording, GISReplay
+   ----------------------- */
+
+GISRecording::GISRecording(const string &filename)
+{
+	m_file.open(filename.c_str(), std::ios::binary | std::ios::trunc);
+	if(!m_file)
+		{ cerr << "ERROR: Could not create GIS recording " << filename << endl; exit(1); }
+
+	m_file.write(GISLOG_MAGIC, 8);
+	uint32_t version = GISLOG_VERSION;
+	m_file.write((const char*) &version, sizeof(version));
+}
+
+
+void GISRecording::add(const string &query, const string &answer)
+{
+	boost::lock_guard<boost::mutex> lock(m_mutex);
+	if(!m_recorded.insert(query).second) return;
+
+	uint32_t length = query.size();
+	m_file.write((const char*) &length, sizeof(length));
+	m_file.write(query.data(), length);
+	length = answer.size();
+	m_file.write((const char*) &length, sizeof(length));
+	m_file.write(answer.data(), length);
+	if(!m_file)
+		{ cerr << "ERROR: Could not write to the GIS recording" << endl; exit(1); }
+}
+
+
+GISReplay::GISReplay(const string &filename)
+{
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if(!file)
+		{ cerr << "ERROR: Could not open GIS recording " << filename << endl; exit(1); }
+
+	char magic[8];
+	uint32_t version = 0;
+	file.read(magic, 8);
+	file.read((char*) &version, sizeof(version));
+	if(!file || memcmp(magic, GISLOG_MAGIC, 8) || version != GISLOG_VERSION)
+		{ cerr << "ERROR: " << filename << " is not a GIS recording" << endl; exit(1); }
+
+	uint32_t length;
+	while(file.read((char*) &length, sizeof(length)))
+	{
+		string query(length, '\0');
+		file.read(&query[0], length);
+		if(!file.read((char*) &length, sizeof(length)))
+			{ cerr << "ERROR: GIS recording " << filename << " is truncated" << endl; exit(1); }
+		string answer(length, '\0');
+		if(!file.read(&answer[0], length))
+			{ cerr << "ERROR: GIS recording " << filename << " is truncated" << endl; exit(1); }
+		m_answers[query].swap(answer);
+	}
+
+	if(m_debug) cout << "DEBUG Loaded " << m_answers.size() << " recorded GIS queries from " << filename << endl;
+}
+
+
+const string& GISReplay::answer(const string &query) const
+{
+	std::unordered_map<string,string>::const_iterator iter = m_answers.find(query);
+	if(iter == m_answers.end())
+	{
+		unsigned char type = query.empty() ? 0 : query[0];
+		cerr << "ERROR: GIS query (" << (type<=GISQ_RESERVEGIDS ? queryNames[type] : "unknown")
+				<< ") is not in the recording, replay with the trace and options it was recorded with" << endl;
+		exit(1);
+	}
+	return iter->second;
+}
+
+
+/* RecordingGISBackend
+   ------------------- */
+
+void RecordingGISBackend::pointCoords(unsigned int gid, float &xgeo, float &ygeo)
+{
+	m_backend->pointCoords(gid, xgeo, ygeo);
+	string answer;
+	put(answer, xgeo);
+	put(answer, ygeo);
+	m_recording.add(queryPointCoords(m_recording, gid), answer);
+}
+
+vector<unsigned int> RecordingGISBackend::pointsInRange(float xcenter, float ycenter, float wgs84range)
+{
+	vector<unsigned int> gids = m_backend->pointsInRange(xcenter, ycenter, wgs84range);
+	m_recording.add(queryInRange(GISQ_POINTSINRANGE, m_recording, xcenter, ycenter, wgs84range), encodeGIDs(gids));
+	return gids;
+}
+
+vector<GISNeighbor> RecordingGISBackend::neighborsInRange(float xcenter, float ycenter, float wgs84range)
+{
+	vector<GISNeighbor> neighbors = m_backend->neighborsInRange(xcenter, ycenter, wgs84range);
+	m_recording.add(queryInRange(GISQ_NEIGHBORSINRANGE, m_recording, xcenter, ycenter, wgs84range), encodeNeighbors(neighbors));
+	return neighbors;
+}
+
+float RecordingGISBackend::distanceToPoint(float xx, float yy, unsigned int gid)
+{
+	float distance = m_backend->distanceToPoint(xx, yy, gid);
+	string answer;
+	put(answer, distance);
+	m_recording.add(queryDistanceToPoint(m_recording, xx, yy, gid), answer);
+	return distance;
+}
+
+bool RecordingGISBackend::lineOfSight(float x1, float y1, float x2, float y2)
+{
+	bool los = m_backend->lineOfSight(x1, y1, x2, y2);
+	m_recording.add(queryLineOfSight(x1, y1, x2, y2), string(1, (char) los));
+	return los;
+}
+
+bool RecordingGISBackend::pointObstructed(float xx, float yy)
+{
+	bool obstructed = m_backend->pointObstructed(xx, yy);
+	m_recording.add(queryPointObstructed(xx, yy), string(1, (char) obstructed));
+	return obstructed;
+}
+
+vector<string> RecordingGISBackend::buildingPolygons()
+{
+	vector<string> polygons = m_backend->buildingPolygons();
+	m_recording.add(newQuery(GISQ_BUILDINGPOLYGONS), encodeStrings(polygons));
+	return polygons;
+}
+
+vector<unsigned int> RecordingGISBackend::reserveGIDs(unsigned int count)
+{
+	vector<unsigned int> gids = m_backend->reserveGIDs(count);
+	m_recording.add(queryReserveGIDs(m_recording, count), encodeGIDs(gids));
+	return gids;
+}
+
+void RecordingGISBackend::syncPoints(const vector<GISPoint> &points)
+{
+	m_backend->syncPoints(points);
+	m_recording.pointsChanged();
+}
+
+void RecordingGISBackend::clearPoints()
+{
+	m_backend->clearPoints();
+	m_recording.pointsChanged();
+}
+
+
+/* ReplayGISBackend
+   ---------------- */
+
+void ReplayGISBackend::pointCoords(unsigned int gid, float &xgeo, float &ygeo)
+{
+	ByteReader reader(m_replay.answer(queryPointCoords(m_replay, gid)));
+	xgeo = reader.get<float>();
+	ygeo = reader.get<float>();
+}
+
+vector<unsigned int> ReplayGISBackend::pointsInRange(float xcenter, float ycenter, float wgs84range)
+{
+	return decodeGIDs(m_replay.answer(queryInRange(GISQ_POINTSINRANGE, m_replay, xcenter, ycenter, wgs84range)));
+}
+
+vector<GISNeighbor> ReplayGISBackend::neighborsInRange(float xcenter, float ycenter, float wgs84range)
+{
+	return decodeNeighbors(m_replay.answer(queryInRange(GISQ_NEIGHBORSINRANGE, m_replay, xcenter, ycenter, wgs84range)));
+}
+
+float ReplayGISBackend::distanceToPoint(float xx, float yy, unsigned int gid)
+{
+	ByteReader reader(m_replay.answer(queryDistanceToPoint(m_replay, xx, yy, gid)));
+	return reader.get<float>();
+}
+
+bool ReplayGISBackend::lineOfSight(float x1, float y1, float x2, float y2)
+{
+	ByteReader reader(m_replay.answer(queryLineOfSight(x1, y1, x2, y2)));
+	return reader.get<uint8_t>();
+}
+
+bool ReplayGISBackend::pointObstructed(float xx, float yy)
+{
+	ByteReader reader(m_replay.answer(queryPointObstructed(xx, yy)));
+	return reader.get<uint8_t>();
+}
+
+vector<string> ReplayGISBackend::buildingPolygons()
+{
+	return decodeStrings(m_replay.answer(newQuery(GISQ_BUILDINGPOLYGONS)));
+}
+
+vector<unsigned int> ReplayGISBackend::reserveGIDs(unsigned int count)
+{
+	return decodeGIDs(m_replay.answer(queryReserveGIDs(m_replay, count)));
+}
+
+void ReplayGISBackend::syncPoints(const vector<GISPoint> &points)
+{
+	m_replay.pointsChanged();
+}
+
+void ReplayGISBackend::clearPoints()
+{
+	m_replay.pointsChanged();
+}
+
+
+GISBackend* GIS_openBackend(const string &options, bool createTables, GISRecording *recording, GISReplay *replay)
+{
+	if(replay)
+		return new ReplayGISBackend(*replay);
+	if(recording)
+		return new RecordingGISBackend(new PostGISBackend(options, createTables), *recording);
+	return new PostGISBackend(options, createTables);
+}
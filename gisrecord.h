@@ -0,0 +1,125 @@
+#ifndef GISRECORD_H_
+#define GISRECORD_H_
+
+#include <fstream>
+#include <cstring>
+#include <unordered_set>
+#include <boost/thread/mutex.hpp>
+#include "gissumo.h"
+#include "gisbackend.h"
+extern bool m_debug;
+
+
+/* Recording and replaying GIS queries, so a run can be repeated without a database.
+ *
+ * A recording is a binary file of (query, answer) entries, each query written once:
+ *   header: "GSGISLOG", uint32 version
+ *   entry:  uint32 query length, query bytes, uint32 answer length, answer bytes
+ * A query is its type and its inputs as raw bytes. Queries on points also carry the
+ * number of point syncs seen so far, since the same question gets a different answer
+ * once vehicles have moved. A run with the same trace and options as the recorded one
+ * asks exactly the same queries, in whatever order threads happen to ask them.
+ */
+class GISQueryLog {
+public:
+	GISQueryLog() : m_pointsVersion(0), m_reserveCalls(0) {}
+
+	// Called on every sync or clear of the points.
+	void pointsChanged() { m_pointsVersion++; }
+
+	// Number of point syncs and clears so far, part of every query on points.
+	unsigned int pointsVersion() const { return m_pointsVersion; }
+
+	// Sequence number of a gid reservation, they are only made from the main thread.
+	unsigned int nextReserveCall() { return m_reserveCalls++; }
+
+private:
+	unsigned int m_pointsVersion;
+	unsigned int m_reserveCalls;
+};
+
+
+// The file side of a recording. Entries may be added from several threads.
+class GISRecording : public GISQueryLog {
+public:
+	// Creates (or truncates) the recording file.
+	GISRecording(const string &filename);
+
+	// Appends an entry, unless this query was already recorded.
+	void add(const string &query, const string &answer);
+
+private:
+	std::ofstream m_file;
+	std::unordered_set<string> m_recorded;
+	boost::mutex m_mutex;
+};
+
+
+// The file side of a replay: every recorded entry, read once and looked up from any thread.
+class GISReplay : public GISQueryLog {
+public:
+	// Reads a recording made by GISRecording.
+	GISReplay(const string &filename);
+
+	// Returns the recorded answer to a query. A query that wasn't recorded is an error.
+	const string& answer(const string &query) const;
+
+	size_t size() const { return m_answers.size(); }
+
+private:
+	std::unordered_map<string,string> m_answers;
+};
+
+
+/* Passes every query to another backend and records its answer.
+ */
+class RecordingGISBackend : public GISBackend {
+public:
+	// Takes ownership of backend.
+	RecordingGISBackend(GISBackend *backend, GISRecording &recording) : m_backend(backend), m_recording(recording) {}
+	~RecordingGISBackend() { delete m_backend; }
+
+	virtual void pointCoords(unsigned int gid, float &xgeo, float &ygeo);
+	virtual vector<unsigned int> pointsInRange(float xcenter, float ycenter, float wgs84range);
+	virtual vector<GISNeighbor> neighborsInRange(float xcenter, float ycenter, float wgs84range);
+	virtual float distanceToPoint(float xx, float yy, unsigned int gid);
+	virtual bool lineOfSight(float x1, float y1, float x2, float y2);
+	virtual bool pointObstructed(float xx, float yy);
+	virtual vector<string> buildingPolygons();
+	virtual vector<unsigned int> reserveGIDs(unsigned int count);
+	virtual void syncPoints(const vector<GISPoint> &points);
+	virtual void clearPoints();
+
+private:
+	GISBackend *m_backend;
+	GISRecording &m_recording;
+};
+
+
+/* Answers every query from a recording. Writing points only moves the replay along.
+ */
+class ReplayGISBackend : public GISBackend {
+public:
+	ReplayGISBackend(GISReplay &replay) : m_replay(replay) {}
+
+	virtual void pointCoords(unsigned int gid, float &xgeo, float &ygeo);
+	virtual vector<unsigned int> pointsInRange(float xcenter, float ycenter, float wgs84range);
+	virtual vector<GISNeighbor> neighborsInRange(float xcenter, float ycenter, float wgs84range);
+	virtual float distanceToPoint(float xx, float yy, unsigned int gid);
+	virtual bool lineOfSight(float x1, float y1, float x2, float y2);
+	virtual bool pointObstructed(float xx, float yy);
+	virtual vector<string> buildingPolygons();
+	virtual vector<unsigned int> reserveGIDs(unsigned int count);
+	virtual void syncPoints(const vector<GISPoint> &points);
+	virtual void clearPoints();
+
+private:
+	GISReplay &m_replay;
+};
+
+
+// Opens a backend: a replay if there is one, otherwise PostGIS on a new connection,
+// recorded if there is a recording.
+GISBackend* GIS_openBackend(const string &options, bool createTables, GISRecording *recording, GISReplay *replay);
+
+#endif /* GISRECORD_H_ */
@@ -2,17 +2,24 @@
 #include "gis.h"
 #include "network.h"
 #include "uvcast.h"
+#include "fcd.h"
+#include "gisrecord.h"
+#include "coverage.h"
+#include "placement.h"
+#include <iomanip>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define XML_PATH "./fcdoutput.xml"
 
-const ptree& empty_ptree(){
-    static ptree t;
-    return t;
-}
-
 // Can extern the debug variable.
 bool m_debug = false;
 bool m_rsu = false;
+bool m_mirrorPoints = false;
+bool m_postgisRange = false;
+// The city map, Porto unless --map-extent sets another
+CityExtent cityExtent = { DEFAULT_XREFERENCE, DEFAULT_YREFERENCE, DEFAULT_XCENTER, DEFAULT_YCENTER, DEFAULT_CITYWIDTH, DEFAULT_CITYHEIGHT };
 // From network
 extern map<float,int> s_packetPropagationTime;
 
@@ -33,9 +40,29 @@ int main(int argc, char *argv[])
 	bool m_debugCellMaps = false;
 	bool m_networkEnabled = false;
 	unsigned short m_accidentTime=60;
+	unsigned short m_startTime=0;
 	unsigned short m_stopTime=0;
+	string m_bbox;
+	bool m_clipToMap = false;
 	string m_fcdFile = "./fcdoutput.xml";
+	string m_convertFile;
+	unsigned short m_fcdListen = 0;
 	unsigned short m_pause = 0;
+	unsigned short m_ingestBuffers = 4;
+	unsigned short m_parseThreads = 0;
+	unsigned short m_substep = 0;
+	bool m_postgisLOS = false;
+	string m_visibilityFile;
+	string m_buildVisibilityFile;
+	string m_dbOptions = "dbname=shapefiledb user=abreis";
+	unsigned short m_dbConnections = 1;
+	bool m_pipelineQueries = false;
+	string m_recordGISFile;
+	string m_replayGISFile;
+	string m_staticCoverageDir;
+	bool m_incrementalCoverage = false;
+	string m_mapExtent;
+	unsigned short m_optimizeRSU = 0;
 
 	// List of command line options
 	options_description cliOptDesc("Options");
@@ -44,13 +71,35 @@ int main(int argc, char *argv[])
 		("print-signal-map", "prints an ASCII map of signal quality")
 		("print-statistics", "outputs coverage metrics")
 		("print-end-statistics", "output final counts")
-		("check-valid-vehicles", "counts number of vehicles in the clear")
+		("check-valid-vehicles", "counts number of vehicles in the clear, over the records the simulation reads")
 		("enable-network", "enables the network layer and packet transmission")
 		("enable-rsu", "enables the RSU communication code")
 		("accident-time", boost::program_options::value<unsigned short>(), "creates an accident at a specific time")
+		("start-time", boost::program_options::value<unsigned short>(), "skips timesteps before a specific time")
 		("stop-time", boost::program_options::value<unsigned short>(), "stops the simulation at a specific time")
+		("bbox", boost::program_options::value<string>(), "only reads vehicles inside xmin,ymin,xmax,ymax (WGS84)")
+		("clip-to-map", "only reads vehicles that fall on the city map")
 		("pause", boost::program_options::value<unsigned short>(), "pauses for N milliseconds after every timestep")
-		("fcd-data", boost::program_options::value<string>(), "floating car data file location")
+		("substep", boost::program_options::value<unsigned short>(), "also runs the network every N milliseconds between timesteps, on interpolated positions")
+		("fcd-data", boost::program_options::value<string>(), "floating car data file location (XML or binary trace, '-' for stdin)")
+		("fcd-listen", boost::program_options::value<unsigned short>(), "reads floating car data live from a TCP connection on localhost:port")
+		("ingest-buffers", boost::program_options::value<unsigned short>(), "timesteps decoded ahead on a reader thread (default 4, 0 reads inline)")
+		("postgis-los", "asks PostGIS for every line of sight instead of testing against buildings loaded in memory")
+		("visibility", boost::program_options::value<string>(), "answers line of sight between map cells from a precomputed visibility matrix file")
+		("build-visibility", boost::program_options::value<string>(), "computes the cell visibility matrix from the buildings, writes it to a file and exits")
+		("db", boost::program_options::value<string>(), "PostgreSQL connection string (default \"dbname=shapefiledb user=abreis\")")
+		("db-connections", boost::program_options::value<unsigned short>(), "database connections for parallel GIS work (default 1, no parallelism)")
+		("pipeline-queries", "sends PostGIS neighbor queries ahead over a pipelined connection (with --postgis-range)")
+		("mirror-points", "also writes vehicle and RSU positions to PostGIS every timestep")
+		("postgis-range", "asks PostGIS for neighbors in range instead of the in-memory grid (implies --mirror-points)")
+		("map-extent", boost::program_options::value<string>(), "sets the city map to xmin,ymin,xmax,ymax (WGS84), or to the extent of the buildings with 'gis' (default: Porto)")
+		("static-coverage", boost::program_options::value<string>(), "computes each RSU's coverage once for every cell in range, cached in a directory, instead of every timestep from the vehicles it sees")
+		("incremental-coverage", "updates RSU coverage only in cells that vehicles entered or left since the last timestep")
+		("optimize-rsu", boost::program_options::value<unsigned short>(), "reads the whole trace, prints the N RSU sites that give its vehicles the best signal and exits")
+		("record-gis", boost::program_options::value<string>(), "records every GIS query the database answers to a file")
+		("replay-gis", boost::program_options::value<string>(), "answers GIS queries from a --record-gis file, no database needed (same trace and options)")
+		("parse-threads", boost::program_options::value<unsigned short>(), "parses an uncompressed XML file up front on N threads, holding it in memory")
+		("convert-fcd", boost::program_options::value<string>(), "converts the floating car data to a binary trace file and exits")
 	    ("debug", "enable debug mode")
 	    ("debug-locations", "debug vehicle location updates")
 	    ("debug-cell-maps", "debug cell map updates")
@@ -75,71 +124,215 @@ int main(int argc, char *argv[])
 	if (varMap.count("enable-network")) 		m_networkEnabled=true;
 	if (varMap.count("enable-rsu")) 			m_rsu=true;
 	if (varMap.count("accident-time")) 			m_accidentTime=varMap["accident-time"].as<unsigned short>();
+	if (varMap.count("start-time")) 			m_startTime=varMap["start-time"].as<unsigned short>();
 	if (varMap.count("stop-time")) 				m_stopTime=varMap["stop-time"].as<unsigned short>();
+	if (varMap.count("bbox")) 					m_bbox=varMap["bbox"].as<string>();
+	if (varMap.count("clip-to-map")) 			m_clipToMap=true;
 	if (varMap.count("check-valid-vehicles"))	m_validVehicle=true;
 	if (varMap.count("pause"))					m_pause=varMap["pause"].as<unsigned short>();
+	if (varMap.count("substep"))				m_substep=varMap["substep"].as<unsigned short>();
 	if (varMap.count("fcd-data"))				m_fcdFile=varMap["fcd-data"].as<string>();
+	if (varMap.count("ingest-buffers"))			m_ingestBuffers=varMap["ingest-buffers"].as<unsigned short>();
+	if (varMap.count("postgis-los"))			m_postgisLOS=true;
+	if (varMap.count("visibility"))				m_visibilityFile=varMap["visibility"].as<string>();
+	if (varMap.count("build-visibility"))		m_buildVisibilityFile=varMap["build-visibility"].as<string>();
+	if (varMap.count("db"))						m_dbOptions=varMap["db"].as<string>();
+	if (varMap.count("db-connections"))			m_dbConnections=varMap["db-connections"].as<unsigned short>();
+	if (varMap.count("pipeline-queries"))		m_pipelineQueries=true;
+	if (varMap.count("mirror-points"))			m_mirrorPoints=true;
+	if (varMap.count("postgis-range"))			m_postgisRange=m_mirrorPoints=true;
+	if (varMap.count("map-extent"))				m_mapExtent=varMap["map-extent"].as<string>();
+	if (varMap.count("static-coverage"))		m_staticCoverageDir=varMap["static-coverage"].as<string>();
+	if (varMap.count("incremental-coverage"))	m_incrementalCoverage=true;
+	if (varMap.count("optimize-rsu"))			m_optimizeRSU=varMap["optimize-rsu"].as<unsigned short>();
+	if (varMap.count("record-gis"))				m_recordGISFile=varMap["record-gis"].as<string>();
+	if (varMap.count("replay-gis"))				m_replayGISFile=varMap["replay-gis"].as<string>();
+	if (varMap.count("parse-threads"))			m_parseThreads=varMap["parse-threads"].as<unsigned short>();
+	if (varMap.count("fcd-listen"))				m_fcdListen=varMap["fcd-listen"].as<unsigned short>();
+	if (varMap.count("convert-fcd"))			m_convertFile=varMap["convert-fcd"].as<string>();
 	if (varMap.count("help")) 					{ cout << cliOptDesc; return 1; }
 
+	/* GIS backend: PostGIS, or a recording of its answers replayed without a database.
+	 * A password can be added to the connection string (--db).
+	 */
+	if(!m_recordGISFile.empty() && !m_replayGISFile.empty())
+		{ cerr << "ERROR: --record-gis and --replay-gis can't be used together" << endl; return 1; }
+	std::unique_ptr<GISRecording> gisRecording;
+	std::unique_ptr<GISReplay> gisReplay;
+	if(!m_recordGISFile.empty()) gisRecording.reset(new GISRecording(m_recordGISFile));
+	if(!m_replayGISFile.empty()) gisReplay.reset(new GISReplay(m_replayGISFile));
+
+	/* Map extent: Porto by default, an area given as xmin,ymin,xmax,ymax, or the area the
+	 * buildings cover ('gis'), with a CITYMARGIN of cells around it for radio range.
+	 * Cells are worked out from it as soon as the trace is read, so it is set first.
+	 */
+	std::unique_ptr<GISBackend> gisBackend;
+	if(m_mapExtent=="gis")
+	{
+		gisBackend.reset(GIS_openBackend(m_dbOptions, true, gisRecording.get(), gisReplay.get()));
+		BuildingIndex extentBuildings;	// with --postgis-los, only loaded to measure them
+		BuildingIndex &buildings = m_postgisLOS ? extentBuildings : gisBuildings;
+		buildings.load(*gisBackend);
+		if(!buildings.size())
+			{ cerr << "ERROR: --map-extent gis found no buildings" << endl; return 1; }
+		double xmin, ymin, xmax, ymax;
+		buildings.bounds(xmin, ymin, xmax, ymax);
+		setCityExtent(xmin, ymin, xmax, ymax);
+	}
+	else if(!m_mapExtent.empty())
+	{
+		double xmin, ymin, xmax, ymax;
+		char trailing;
+		if(sscanf(m_mapExtent.c_str(), "%lf,%lf,%lf,%lf%c", &xmin, &ymin, &xmax, &ymax, &trailing) != 4 || xmin>=xmax || ymin>=ymax)
+			{ cerr << "ERROR: --map-extent expects xmin,ymin,xmax,ymax or 'gis'" << endl; return 1; }
+		setCityExtent(xmin, ymin, xmax, ymax);
+	}
+	if(m_debug) cout << "DEBUG City map " << CITYWIDTH << 'x' << CITYHEIGHT << " cells from X=" << setprecision(8)
+			<< XREFERENCE << ",Y=" << YREFERENCE << endl;
+
+	// the visibility matrix grows with the square of the cells, check the extent before building or loading one
+	if((!m_buildVisibilityFile.empty() || !m_visibilityFile.empty()) && VisibilityMatrix::bytes() > VISIBILITY_MAXBYTES)
+		{ cerr << "ERROR: The " << CITYWIDTH << 'x' << CITYHEIGHT << " cell map is too large for a visibility matrix ("
+				<< VisibilityMatrix::bytes()/(1<<20) << " MB), use a smaller --map-extent" << endl; return 1; }
+
+	// Visibility build mode: one pass over every cell pair for this map, then leave, no FCD needed.
+	if(!m_buildVisibilityFile.empty())
+	{
+		if(!gisBackend)
+			gisBackend.reset(GIS_openBackend(m_dbOptions, true, gisRecording.get(), gisReplay.get()));
+		if(!gisBuildings.loaded())
+			gisBuildings.load(*gisBackend);
+		gisVisibility.build(gisBuildings, boost::thread::hardware_concurrency());
+		gisVisibility.save(m_buildVisibilityFile);
+		return 0;
+	}
+
 	if (m_debug) cout << "BEGIN FCD FILE " << m_fcdFile << endl;
 
-	/* Parse SUMO logs
+	/* Open SUMO logs
 	 * This expects SUMO's floating car data (FCD) output with geographic
 	 * coordinates (--fcd-output.geo=true)
-	 * 
+	 *
 	 * The resulting file is XML, with syntax as follows:
 	 * <fcd-export>
 	 *  <timestep time="">
 	 *   <vehicle id="" x="" y="" ... />
-	 * 
-	 * To parse, we're using boost::propertytree, which runs on top of RapidXML.
+	 *
+	 * The file is streamed: FCDReader hands out one timestep at a time as the
+	 * simulation loop asks for it, so the whole trace is never held in memory.
+	 * A binary trace written by --convert-fcd is memory-mapped instead, and
+	 * --parse-threads reads a large XML file in parallel chunks ahead of time.
+	 *
+	 * The time window and area of interest are applied while reading, so timesteps
+	 * and vehicles outside them never reach the simulation (or a converted trace).
 	 */
-
-	// using boost and vector structs
-	ptree tree;
-	read_xml(m_fcdFile, tree);
-	std::vector<Timestep> fcd_output;
-
-	// traverse tree and fill fcd_output with timesteps
-	BOOST_FOREACH ( ptree::value_type const& iterTimestep, tree.get_child("fcd-export") )
+	FCDFilter fcdFilter;
+	fcdFilter.startTime = m_startTime;
+	fcdFilter.stopTime = m_stopTime;
+	fcdFilter.clipToMap = m_clipToMap;
+	if(!m_bbox.empty())
 	{
-		if(iterTimestep.first == "timestep")
-		{
-			Timestep t;
+		fcdFilter.bbox = true;
+		char trailing;
+		if(sscanf(m_bbox.c_str(), "%f,%f,%f,%f%c", &fcdFilter.xmin, &fcdFilter.ymin, &fcdFilter.xmax, &fcdFilter.ymax, &trailing) != 4)
+			{ cerr << "ERROR: --bbox expects xmin,ymin,xmax,ymax" << endl; return 1; }
+	}
+	/* Live input (stdin, a named pipe, or a socket SUMO writes to) is processed one
+	 * timestep at a time as SUMO produces it, so both can run side by side.
+	 */
+	if(m_validVehicle && (m_fcdListen || !FCD_isRegularFile(m_fcdFile)))
+		{ cerr << "ERROR: --check-valid-vehicles reads the trace twice and needs a regular FCD file." << endl; return 1; }
 
-			// get time attribute
-			t.time = iterTimestep.second.get<float>("<xmlattr>.time",0);
+	std::unique_ptr<FCDSource> fcdSource = m_fcdListen ?
+			FCD_openSocket(m_fcdListen, fcdFilter) : FCD_openSource(m_fcdFile, fcdFilter, m_parseThreads);
+	Timestep timestep;
+	unsigned int timestepCount = 0;
 
-			// get second level tree 'vehicles'
-			BOOST_FOREACH ( ptree::value_type const& iterVehicle, iterTimestep.second )
-			{
-				if(iterVehicle.first == "vehicle")
-				{
-					Vehicle v;
+	// Conversion mode: write the binary trace and leave, no database needed.
+	if(!m_convertFile.empty())
+	{
+		FCD_writeBinary(*fcdSource, m_convertFile);
+		return 0;
+	}
 
-					v.id = iterVehicle.second.get<unsigned short>("<xmlattr>.id",0);
-					v.xgeo = iterVehicle.second.get<double>("<xmlattr>.x",0);
-					v.ygeo = iterVehicle.second.get<double>("<xmlattr>.y",0);
-					v.speed = iterVehicle.second.get<double>("<xmlattr>.speed",0);
+	// Decode and cell-map upcoming timesteps on a reader thread while this one simulates.
+	if(m_ingestBuffers)
+		fcdSource.reset(new FCDPipeline(std::move(fcdSource), m_ingestBuffers));
 
-					t.vehiclelist.push_back(v);
-				}
-			}
+	/* Open the GIS backend
+	 * With --db-connections N, N more are pooled for GIS work that can run in parallel.
+	 */
+	if(!gisBackend)
+		gisBackend.reset(GIS_openBackend(m_dbOptions, true, gisRecording.get(), gisReplay.get()));
+	GISBackend &gis = *gisBackend;
+	std::unique_ptr<GISConnectionPool> pool;
+	if(m_dbConnections>1)
+	{
+		pool.reset(new GISConnectionPool(boost::bind(GIS_openBackend, m_dbOptions, false, gisRecording.get(), gisReplay.get()), m_dbConnections));
+		gisPool = pool.get();
+	}
+	std::unique_ptr<GISAsyncQueries> async;
+	if(m_pipelineQueries)
+	{
+		if(!m_postgisRange)
+			{ cerr << "ERROR: --pipeline-queries only applies to --postgis-range" << endl; return 1; }
+		if(gisRecording || gisReplay)
+			{ cerr << "ERROR: --pipeline-queries can't be recorded or replayed" << endl; return 1; }
+		async.reset(new GISAsyncQueries(m_dbOptions));
+		gisAsync = async.get();
+	}
 
-			// store this timestep entry
-			fcd_output.push_back(t);
-		}
+	// With --incremental-coverage, point cells are tracked from the first point on.
+	std::unique_ptr<CoverageTracker> coverageTracker;
+	if(m_incrementalCoverage)
+	{
+		if(!m_staticCoverageDir.empty())
+			{ cerr << "ERROR: --incremental-coverage and --static-coverage can't be used together" << endl; return 1; }
+		coverageTracker.reset(new CoverageTracker);
+		gisCoverage = coverageTracker.get();
 	}
 
-	if(m_debug) cout << "Read " << fcd_output.size() << " records from " << m_fcdFile << endl;
+	// Clear all POINT entities from the database from past simulations.
+	GIS_clearAllPoints(gis);
 
-	/* Open a connection to PostgreSQL
-	 * A password can be added to this string.
-	 */
-	pqxx::connection conn("dbname=shapefiledb user=abreis");
+	// Buildings don't move, load them once so line of sight tests stay out of the database.
+	if(!m_postgisLOS && !gisBuildings.loaded())
+		gisBuildings.load(gis);
+	if(!m_visibilityFile.empty())
+		gisVisibility.load(m_visibilityFile);
 
-	// Clear all POINT entities from the database from past simulations.
-	GIS_clearAllPoints(conn);
+	/* Placement mode: one pass over the trace for the road cells and how busy they are,
+	 * then every candidate site is scored on all cores, the best sites are printed and we leave.
+	 */
+	if(m_optimizeRSU)
+	{
+		if(m_postgisLOS)
+			{ cerr << "ERROR: --optimize-rsu needs line of sight in memory, it can't be used with --postgis-los" << endl; return 1; }
+		RSUPlacement placement;
+		while(fcdSource->nextTimestep(timestep))
+			placement.addTimestep(timestep);
+		placement.evaluate(gis, boost::thread::hardware_concurrency());
+		vector<RSUSite> sites = placement.select(m_optimizeRSU);
+
+		// sites are printed in fixed point, put the stream back as it was afterwards
+		ios::fmtflags flags = cout.flags();
+		streamsize precision = cout.precision();
+		uint64_t total = 0;
+		for(size_t i=0; i<sites.size(); i++)
+		{
+			cout << "RSU " << i+1 << fixed << setprecision(6) << " x " << sites[i].xgeo << " y " << sites[i].ygeo
+					<< " gain " << sites[i].gain << " cells " << sites[i].cellsCovered << endl;
+			total += sites[i].gain;
+		}
+		cout << "STAT rsuPlacement"
+				<< " candidates " << placement.candidates()
+				<< " sites " << sites.size()
+				<< " meanSignal " << setprecision(4) << (placement.vehicleTimesteps() ? (float)total/placement.vehicleTimesteps() : 0)
+				<< endl;
+		cout.flags(flags);
+		cout.precision(precision);
+		return 0;
+	}
 
 	/* Simulation starts here.
 	 * We have a 0.37% mismatch error between the SUMO roads and the Porto shapefile data.
@@ -150,9 +343,10 @@ int main(int argc, char *argv[])
 
 	// setup vectors and maps
 	list<RSU> rsuList;			// vector to hold list of RSUs
-	list<Vehicle> vehiclesOnGIS;	// vehicles we've processed from SUMO to GIS
+	VehicleList vehiclesOnGIS;	// vehicles we've processed from SUMO to GIS
 	CityMapChar vehicleLocations; 		// 2D map for vehicle locations
 	CityMapNum globalSignal;			// 2D map for global signal quality
+	CityMapBits roadCells;				// cells vehicles have been on, for --print-statistics
 
 
 	if(m_rsu)
@@ -160,35 +354,53 @@ int main(int argc, char *argv[])
 		if(m_debug) cout << "DEBUG Adding static RSUs...";
 		// Add an RSU
 		// Bottom left
-		addNewRSU(conn, rsuList, 10000, -8.619278, 41.162600, true);
+		addNewRSU(gis, rsuList, RSUIDBASE+0, -8.619278, 41.162600, true);
 		// Bottom right
-		addNewRSU(conn, rsuList, 10001, -8.614409, 41.162411, true);
+		addNewRSU(gis, rsuList, RSUIDBASE+1, -8.614409, 41.162411, true);
 		// Top right
-		addNewRSU(conn, rsuList, 10002, -8.614507, 41.166282, true);
+		addNewRSU(gis, rsuList, RSUIDBASE+2, -8.614507, 41.166282, true);
 		// Top left
-		addNewRSU(conn, rsuList, 10003, -8.620375, 41.165852, true);
+		addNewRSU(gis, rsuList, RSUIDBASE+3, -8.620375, 41.165852, true);
 //		// North
-//		addNewRSU(conn, rsuList, 10004, -8.617054, 41.167548, true);
+//		addNewRSU(gis, rsuList, RSUIDBASE+4, -8.617054, 41.167548, true);
 //		// East
-//		addNewRSU(conn, rsuList, 10005, -8.614909, 41.164852, true);
+//		addNewRSU(gis, rsuList, RSUIDBASE+5, -8.614909, 41.164852, true);
 //		// South
-//		addNewRSU(conn, rsuList, 10006, -8.617476, 41.163523, true);
+//		addNewRSU(gis, rsuList, RSUIDBASE+6, -8.617476, 41.163523, true);
 //		// West
-//		addNewRSU(conn, rsuList, 10007, -8.620539, 41.164816, true);
+//		addNewRSU(gis, rsuList, RSUIDBASE+7, -8.620539, 41.164816, true);
 		if(m_debug) cout << "done" << endl;
+
+		/* With --static-coverage, RSU coverage is fixed for the whole run, since neither
+		 * RSUs nor buildings move. Applied to the signal map once here, not every timestep.
+		 */
+		if(!m_staticCoverageDir.empty())
+			for(list<RSU>::iterator iterRSU = rsuList.begin(); iterRSU != rsuList.end(); iterRSU++)
+			{
+				loadStaticCoverage(gis, *iterRSU, m_staticCoverageDir);
+				applyCoverageToCityMap(*iterRSU, globalSignal);
+			}
 	}
 
 
+	/* Substeps interpolate towards the next timestep, so then the loop reads one timestep ahead.
+	 * Otherwise it doesn't, so live input is processed as soon as each timestep arrives.
+	 * Substeps only run the network, without it there's nothing to read ahead for.
+	 */
+	bool readAhead = m_substep && m_networkEnabled;
+	Timestep upcoming;
+	TrajectoryInterpolator interpolator;
+	bool haveTimestep = fcdSource->nextTimestep(timestep);
+	bool haveUpcoming = haveTimestep && readAhead && fcdSource->nextTimestep(upcoming);
+
 	// Run through every time step on the FCD XML file
-	for(std::vector<Timestep>::iterator
-			iterTime = fcd_output.begin();
-			iterTime != fcd_output.end();
-			iterTime++ )
+	while(haveTimestep)
 	{
 		/*
 		 * Beginning of each FCD XML time step
 		 */
-		if(m_debug) cout << "\nDEBUG Timestep time=" << iterTime->time << endl;
+		timestepCount++;
+		if(m_debug) cout << "\nDEBUG Timestep time=" << timestep.time << endl;
 
 		/* Mark all vehicles on vehiclesOnGIS as active=false
 		 * The next step remarks the ones on the road (XML) as active=true
@@ -200,47 +412,52 @@ int main(int argc, char *argv[])
 			iter->active=false;
 
 		// run through each vehicle
-		for(std::vector<Vehicle>::iterator
-				iterVeh=iterTime->vehiclelist.begin();
-				iterVeh!=iterTime->vehiclelist.end();
+		for(std::vector<TraceRecord>::iterator
+				iterVeh=timestep.records.begin();
+				iterVeh!=timestep.records.end();
 				iterVeh++)
 		{
 			/*
-			 * Beginning of each vehicle on the FCD trace (already converted to Vehicle entities)
+			 * Beginning of each vehicle on the FCD trace (compact TraceRecords, cells already set)
 			 */
 
 			if(m_debugLocations) cout << "DEBUG Vehicle id=" << iterVeh->id << endl;
 
-			// 0 - Always needed: clone the vehicle and update its position in cells
-			Vehicle newVehicle = *iterVeh;						// copy vehicle from XML iterator
-			determineCellFromWGS84 (newVehicle.xgeo, newVehicle.ygeo,
-					newVehicle.xcell, newVehicle.ycell);		// determine vehicle location in cells
+			// 0 - Always needed: build the vehicle from the trace record
+			Vehicle newVehicle;
+			newVehicle.type = RoadObject::VEHICLE;
+			newVehicle.id = iterVeh->id;
+			newVehicle.xcell = iterVeh->xcell;
+			newVehicle.ycell = iterVeh->ycell;
+			newVehicle.xgeo = iterVeh->xgeo();
+			newVehicle.ygeo = iterVeh->ygeo();
+			newVehicle.speed = iterVeh->speed();
+			newVehicle.parked = false;
+			newVehicle.scf = false;
 			if(m_debugLocations) cout << "DEBUG Vehicle id=" << iterVeh->id << " new xcell=" << newVehicle.xcell << " new ycell=" << newVehicle.ycell << endl;
-			if(m_printVehicleMap || m_printStatistics)
-				vehicleLocations.map[newVehicle.xcell][newVehicle.ycell]='o';	// tag the vehicle citymap
+			if(m_printVehicleMap)
+				vehicleLocations.set(newVehicle.xcell, newVehicle.ycell, 'o');	// tag the vehicle citymap
+			if(m_printStatistics)
+				roadCells.set(newVehicle.xcell, newVehicle.ycell);
 
-			// 1 - See if the vehicle is new.
-			list<Vehicle>::iterator iterVehicleOnGIS = find_if(
-					vehiclesOnGIS.begin(),
-					vehiclesOnGIS.end(),
-					boost::bind(&Vehicle::id, _1) == iterVeh->id	// '_1' means "substitute with the first input argument"
-					);
+			// 1 - See if the vehicle is new. Its id is an interned slot, so this is an array lookup.
+			Vehicle *iterVehicleOnGIS = vehiclesOnGIS.bySlot(iterVeh->id);
 
-			if(iterVehicleOnGIS==vehiclesOnGIS.end())
+			if(!iterVehicleOnGIS)
 			{
 				// 2a - New vehicle. Add it to GIS, get GID, add to our local record.
-				newVehicle.gid = GIS_addPoint(conn,newVehicle.xgeo,newVehicle.ygeo,newVehicle.id);
+				newVehicle.gid = GIS_addPoint(gis,newVehicle.xgeo,newVehicle.ygeo,newVehicle.id);
 				// Mark as active
 				newVehicle.active=true;
 				// Add to our local record
-				vehiclesOnGIS.push_back(newVehicle);
+				vehiclesOnGIS.add(newVehicle);
 				// Debug
 				if(m_debugLocations) cout << "DEBUG Vehicle id=" << iterVeh->id << " is new, added to GIS with gid=" << newVehicle.gid << endl;
 			}
 			else
 			{
 				// 2b - Existing vehicle: update its position on GIS via GID
-				GIS_updatePoint(conn,newVehicle.xgeo,newVehicle.ygeo,iterVehicleOnGIS->gid);
+				GIS_updatePoint(gis,newVehicle.xgeo,newVehicle.ygeo,iterVehicleOnGIS->gid);
 				// Update our local copy
 				iterVehicleOnGIS->xcell = newVehicle.xcell;
 				iterVehicleOnGIS->ycell = newVehicle.ycell;
@@ -262,11 +479,13 @@ int main(int argc, char *argv[])
 
 		}	// end for(vehicle)
 
+		// With --mirror-points, write the whole timestep's positions to PostGIS in one go.
+		GIS_syncPoints(gis);
+
 
 		/* Vehicles are now in the GIS map as POINTs.
 		 * All new vehicles added to GIS, all existing vehicles' positions updated on GIS.
-		 * The first level of fcd_output is a time entity, the second level is a vehiclelist
-		 * of Vehicle entities from XML.
+		 * timestep holds the time and the trace records read for it.
 		 * vehiclesOnGIS is our local database of updated vehicles.
 		 * rsuList has our RSUs.
 		 */
@@ -274,58 +493,19 @@ int main(int argc, char *argv[])
 
 		/* Go through each RSU and update its coverage map.
 		 * This is computed from the vehicles the RSU sees, and their signal strength.
+		 * Static coverage (--static-coverage) was already applied once, before the first timestep.
+		 * Incremental coverage (--incremental-coverage) only redoes cells that vehicles entered or left.
 		 */
-		for(list<RSU>::iterator iterRSU = rsuList.begin();
-			iterRSU != rsuList.end();
-			iterRSU++)
+		if(gisCoverage)
+			gisCoverage->update(gis, rsuList, globalSignal, m_debugCellMaps);
+		else if(m_staticCoverageDir.empty())
 		{
-			// first get the RSU's neighbors' GIDs
-			vector<unsigned int> rsuNeighs = GIS_getPointsInRange(conn,iterRSU->xgeo,iterRSU->ygeo,MAXRANGE);
-
-			// now run through each neighbor
-			for(vector<unsigned int>::iterator neighbor=rsuNeighs.begin();
-					neighbor != rsuNeighs.end();
-					neighbor++)
-			{
-				// get distance from neighbor to RSU
-				unsigned short distneigh = GIS_distanceToPointGID(conn,iterRSU->xgeo,iterRSU->ygeo,*neighbor);
-
-				if(distneigh)	// ignore ourselves (distance==0)
-				{
-					// carry debug
-					if(m_debugCellMaps) cout << "DEBUG\t neighbor gid=" << *neighbor << " distance " << distneigh << '\n';
-
-					// get the neighbor's coordinates
-					float xgeoneigh=0, ygeoneigh=0;
-					GIS_getPointCoords(conn, *neighbor, xgeoneigh, ygeoneigh);
-					if(m_debugCellMaps) cout << "DEBUG\t neighbor gid=" << *neighbor << setprecision(8) << " at xgeo=" << xgeoneigh << " ygeo=" << ygeoneigh << '\n';
-
-					// convert them to cells
-					unsigned short xcellneigh=0, ycellneigh=0;
-					determineCellFromWGS84(xgeoneigh,ygeoneigh,xcellneigh,ycellneigh);
-					if(m_debugCellMaps) cout << "DEBUG\t neighbor gid=" << *neighbor << " cell coords as xcell=" << xcellneigh << "\t ycell=" << ycellneigh << '\n';
+			updateRSUCoverages(gis, rsuList, m_debugCellMaps);
 
-					// determine LOS status
-					bool LOSneigh = GIS_isLineOfSight(conn,iterRSU->xgeo,iterRSU->ygeo,xgeoneigh,ygeoneigh);
-					if(m_debugCellMaps) cout << "DEBUG\t neighbor gid=" << *neighbor << " LOS " << (LOSneigh?"true":"false") << '\n';
-
-					// determine signal quality
-					unsigned short signalneigh = getSignalQuality(distneigh,LOSneigh);
-					if(m_debugCellMaps) cout << "DEBUG\t neighbor gid=" << *neighbor << " signal " << signalneigh << '\n';
-
-					// update RSU coverage map
-					short xrelative = PARKEDCELLRANGE + xcellneigh - iterRSU->xcell;
-					short yrelative = PARKEDCELLRANGE + ycellneigh - iterRSU->ycell;
-					iterRSU->coverage[xrelative][yrelative]=signalneigh;
-					if(m_debugCellMaps) cout << "DEBUG\t neighbor gid=" << *neighbor << " on RSU map at xcell=" << xrelative << " ycell=" << yrelative << '\n';
-
-				}	// end distance!=0
-			}	// end for(RSU neighbors)
-
-			// now that the RSU's local map is updated, apply this map to the global signal map
-			applyCoverageToCityMap(*iterRSU, globalSignal);
-
-		}	// end for(RSUs)
+			// now that the RSUs' local maps are updated, apply them to the global signal map
+			for(list<RSU>::iterator iterRSU = rsuList.begin(); iterRSU != rsuList.end(); iterRSU++)
+				applyCoverageToCityMap(*iterRSU, globalSignal);
+		}
 
 		/* Network layer.
 		 * Act on vehiclesOnGIS and rsuList, and disseminate packets.
@@ -333,18 +513,18 @@ int main(int argc, char *argv[])
 		 */
 		if(m_networkEnabled)
 		{
-			processNetwork(conn,iterTime->time,vehiclesOnGIS,rsuList);
+			processNetwork(gis,timestep.time,vehiclesOnGIS,rsuList);
 
 			// Create an accident in the middle of the map
 			// Locate a random vehicle at the center of the map to be the accident source
 			// Get a specific vehicle to act as the accident source
-			if(iterTime->time==m_accidentTime)
+			if(timestep.time==m_accidentTime)
 			{
 				// Locate a vehicle. Map center is at YCENTER XCENTER
 				// we begin with a range of 8, and keep doubling it until one vehicle is found
 				vector<Vehicle*> centerVehicles; unsigned short centerRange=8;
 				do{
-					centerVehicles = getVehiclesNearPoint(conn,vehiclesOnGIS, XCENTER, YCENTER, centerRange);
+					centerVehicles = getVehiclesNearPoint(gis,vehiclesOnGIS, XCENTER, YCENTER, centerRange);
 					centerRange *= 2;
 				} while(centerVehicles.size()==0);
 
@@ -354,7 +534,7 @@ int main(int argc, char *argv[])
 						<< " ygeo " << (*(centerVehicles.begin()))->xgeo
 						<< endl;
 
-						simulateAccident(conn, iterTime->time, vehiclesOnGIS, rsuList, *(centerVehicles.begin()) );
+						simulateAccident(gis, timestep.time, vehiclesOnGIS, rsuList, *(centerVehicles.begin()) );
 			}
 		}
 
@@ -365,7 +545,7 @@ int main(int argc, char *argv[])
 		 */
 		if(m_printStatistics)
 		{
-			short countInactive=0, countActive=0;
+			unsigned int countInactive=0, countActive=0;
 			for(list<Vehicle>::iterator
 					iter=vehiclesOnGIS.begin();
 					iter!=vehiclesOnGIS.end();
@@ -379,35 +559,17 @@ int main(int argc, char *argv[])
 
 		if(m_printStatistics)
 		{
-			// count the number of 'road' cells
-			unsigned short roadCells = 0;
-			for(short xx=0;xx<CITYWIDTH;xx++)
-				for(short yy=0;yy<CITYHEIGHT;yy++)
-					if(vehicleLocations.map[xx][yy]!=' ')
-						roadCells++;
-
-			// count the number of covered cells
-			unsigned short roadCellsCovered = 0;
-			for(short xx=0;xx<CITYWIDTH;xx++)
-				for(short yy=0;yy<CITYHEIGHT;yy++)
-					if(globalSignal.map[xx][yy]!=0)
-						roadCellsCovered++;
-
-			// determine the mean coverage of all valid cells
-			unsigned short roadCellsSignalSum = 0;
-			float roadCellsMeanSignal = 0;
-			for(short xx=0;xx<CITYWIDTH;xx++)
-				for(short yy=0;yy<CITYHEIGHT;yy++)
-					if(globalSignal.map[xx][yy]!=0)
-						roadCellsSignalSum+=globalSignal.map[xx][yy];
-			roadCellsMeanSignal = (float)roadCellsSignalSum/(float)roadCells;
-			if(m_debug) cout << "DEBUG Road Cell Signal Sum " << roadCellsSignalSum << endl;
+			// road cells, covered cells and signal sum, all in one pass
+			CoverageStats stats;
+			computeCoverageStats(roadCells, globalSignal, stats);
+			float roadCellsMeanSignal = (float)stats.signalSum/(float)stats.roadCells;
+			if(m_debug) cout << "DEBUG Road Cell Signal Sum " << stats.signalSum << endl;
 
 			cout << "STAT"
-					<< " cells " << roadCells
-					<< " cellsCovered " << roadCellsCovered
+					<< " cells " << stats.roadCells
+					<< " cellsCovered " << stats.coveredCells
 					<< " cellsMeanSignal " << roadCellsMeanSignal
-					<< " cellsCoveredMeanSignal " << ( (float)roadCellsSignalSum/(float)roadCellsCovered )
+					<< " cellsCoveredMeanSignal " << ( (float)stats.signalSum/(float)stats.coveredCells )
 					<< endl;
 		}
 
@@ -416,22 +578,21 @@ int main(int argc, char *argv[])
 		if(m_printSignalMap && m_printVehicleMap)
 		{
 			// Apply signal map to vehicle map
-			for(short xx=0;xx<CITYWIDTH;xx++)
-				for(short yy=0;yy<CITYHEIGHT;yy++)
-					if(globalSignal.map[xx][yy])
-						vehicleLocations.map[xx][yy]=boost::lexical_cast<char>(globalSignal.map[xx][yy]);
+			for(vector<unsigned int>::const_iterator tile=globalSignal.liveTiles().begin(); tile!=globalSignal.liveTiles().end(); tile++)
+				for(short xx=0;xx<CITYTILE;xx++)
+					for(short yy=0;yy<CITYTILE;yy++)
+						if(globalSignal.tile(*tile)[xx][yy])
+							vehicleLocations.set(globalSignal.tileX(*tile)+xx, globalSignal.tileY(*tile)+yy,
+									(char)('0'+globalSignal.tile(*tile)[xx][yy]));
 			// overlay RSUs on the map
 			for(list<RSU>::iterator iter=rsuList.begin(); iter!=rsuList.end(); iter++)
 				if(iter->active)
-					vehicleLocations.map[iter->xcell][iter->ycell]='R';
+					vehicleLocations.set(iter->xcell, iter->ycell, 'R');
 			// print the vehicle map
-			cout << "Timestep: " << iterTime->time << '\n';
+			cout << "Timestep: " << timestep.time << '\n';
 			printCityMap(vehicleLocations);
 			// clean map
-			for(short xx=0;xx<CITYWIDTH;xx++)
-				for(short yy=0;yy<CITYHEIGHT;yy++)
-					if(vehicleLocations.map[xx][yy]=='o' || vehicleLocations.map[xx][yy]=='R')
-						vehicleLocations.map[xx][yy]='.';
+			cleanVehicleMap(vehicleLocations);
 		}
 		else
 		{
@@ -442,12 +603,9 @@ int main(int argc, char *argv[])
 			{
 				for(list<RSU>::iterator iter=rsuList.begin(); iter!=rsuList.end(); iter++)
 					if(iter->active)
-						vehicleLocations.map[iter->xcell][iter->ycell]='R';		// overlay RSUs on the map
+						vehicleLocations.set(iter->xcell, iter->ycell, 'R');		// overlay RSUs on the map
 				printCityMap(vehicleLocations);			// print the vehicle map
-				for(short xx=0;xx<CITYWIDTH;xx++)		// clean map
-					for(short yy=0;yy<CITYHEIGHT;yy++)
-						if(vehicleLocations.map[xx][yy]=='o' || vehicleLocations.map[xx][yy]=='R')
-							vehicleLocations.map[xx][yy]='.';
+				cleanVehicleMap(vehicleLocations);		// clean map
 			}
 		}
 		if(m_pause)
@@ -457,10 +615,49 @@ int main(int argc, char *argv[])
 		 * End of each time step
 		 */
 
-		if(m_stopTime && iterTime->time>=m_stopTime)
+		if(m_stopTime && timestep.time>=m_stopTime)
 			break;
+
+		/* Network substeps.
+		 * Between this timestep and the next one, move the active vehicles to positions interpolated
+		 * from the two samples, and run the network layer again.
+		 */
+		if(readAhead && haveUpcoming)
+		{
+			interpolator.setInterval(timestep, upcoming);
+			for(unsigned int sub=1; ; sub++)
+			{
+				float subTime = timestep.time + sub*m_substep/1000.0;
+				if(subTime > upcoming.time - 0.0005) break;	// the next timestep has the real sample
+				if(m_debug) cout << "\nDEBUG Substep time=" << subTime << endl;
+
+				for(list<Vehicle>::iterator
+						iter=vehiclesOnGIS.begin();
+						iter!=vehiclesOnGIS.end();
+						iter++)
+					if(iter->active && interpolator.positionAt(iter->id, subTime, iter->xgeo, iter->ygeo))
+					{
+						determineCellFromWGS84(iter->xgeo, iter->ygeo, iter->xcell, iter->ycell);
+						GIS_updatePoint(gis, iter->xgeo, iter->ygeo, iter->gid);
+					}
+				GIS_syncPoints(gis);
+
+				processNetwork(gis,subTime,vehiclesOnGIS,rsuList);
+			}
+		}
+
+		// Move on to the next timestep.
+		if(readAhead)
+		{
+			std::swap(timestep, upcoming);
+			haveTimestep = haveUpcoming;
+			haveUpcoming = haveTimestep && fcdSource->nextTimestep(upcoming);
+		}
+		else
+			haveTimestep = fcdSource->nextTimestep(timestep);
 	}	// end for(timestep)
 
+	if(m_debug) cout << "Read " << timestepCount << " timesteps from " << m_fcdFile << endl;
 
 	/* Print final count of packet propagation times.
 	 */
@@ -478,17 +675,25 @@ int main(int argc, char *argv[])
 	// DEBUG: go through every vehicle position and see if it's not inside a building.
 	if(m_validVehicle)
 	{
+		// stream the trace a second time through the same filter, the simulation loop may have stopped early.
+		// The first source goes first: a pipeline's reader thread may still be interning IDs.
+		fcdSource.reset();
 		unsigned int bumpcount=0, clearcount=0;
-		for(std::vector<Timestep>::iterator iter1=fcd_output.begin(); iter1 != fcd_output.end(); iter1++)
-			for(std::vector<Vehicle>::iterator iter2=iter1->vehiclelist.begin(); iter2!=iter1->vehiclelist.end(); iter2++)
-				if( GIS_isPointObstructed(conn,iter2->xgeo,iter2->ygeo) ) bumpcount++; else clearcount++;
+		std::unique_ptr<FCDSource> validSource = FCD_openSource(m_fcdFile, fcdFilter, m_parseThreads);
+		vector<char> obstructed;
+		while(validSource->nextTimestep(timestep))
+		{
+			GIS_pointsObstructed(gis, timestep.records, obstructed);
+			for(vector<char>::iterator iter2=obstructed.begin(); iter2!=obstructed.end(); iter2++)
+				if(*iter2) bumpcount++; else clearcount++;
+		}
 		cout << "bump " << bumpcount << " clear " << clearcount << endl;
 	}
 
 
 	// Clear all POINT entities from the database from past simulations.
 	// Uncomment this to leave the GIS database in a clean state after the simulation.
-//	GIS_clearAllPoints(conn);
+//	GIS_clearAllPoints(gis);
 
 	return 0;
 }
@@ -509,22 +714,83 @@ unsigned int deltaSeconds(float c1, float c2)
 	return (unsigned int) floor(fabs(c1-c2)*3600);
 }
 
-void printCityMap (CityMapChar cmap)
+unsigned int VehicleIDTable::intern(const string &sumoID)
+{
+	std::pair<std::unordered_map<string,unsigned int>::iterator,bool> slot =
+			m_slots.insert(std::make_pair(sumoID, (unsigned int) m_names.size()));
+	if(slot.second)
+	{
+		if(m_names.size() >= RSUIDBASE)
+			{ cerr << "ERROR: Too many vehicle IDs, slots would run into the RSU ids." << endl; exit(1); }
+		m_names.push_back(sumoID);
+	}
+	return slot.first->second;
+}
+
+Vehicle* VehicleList::add(const Vehicle &veh)
+{
+	push_back(veh);
+	Vehicle *stored = &back();
+
+	if(veh.id >= m_slots.size())
+		m_slots.resize(veh.id+1, NULL);
+	m_slots[veh.id] = stored;
+
+	// the first gid seen sets the base; an older one moves it down
+	if(m_gids.empty())
+		m_gidBase = veh.gid;
+	else if(veh.gid < m_gidBase)
+	{
+		m_gids.insert(m_gids.begin(), m_gidBase-veh.gid, NULL);
+		m_gidBase = veh.gid;
+	}
+	if(veh.gid-m_gidBase >= m_gids.size())
+		m_gids.resize(veh.gid-m_gidBase+1, NULL);
+	m_gids[veh.gid-m_gidBase] = stored;
+
+	return stored;
+}
+
+void setCityExtent(double xmin, double ymin, double xmax, double ymax)
+{
+	double width = ceil((xmax-xmin)*3600) + 2*CITYMARGIN;
+	double height = ceil((ymax-ymin)*3600) + 2*CITYMARGIN;
+	if(width>65535 || height>65535)
+		{ cerr << "ERROR: The map extent is too large, cells are numbered up to 65535" << endl; exit(1); }
+
+	cityExtent.xreference = xmin - CITYMARGIN/3600.0;
+	cityExtent.yreference = ymax + CITYMARGIN/3600.0;
+	cityExtent.xcenter = (xmin+xmax)/2;
+	cityExtent.ycenter = (ymin+ymax)/2;
+	cityExtent.width = (unsigned short) width;
+	cityExtent.height = (unsigned short) height;
+}
+
+void cleanVehicleMap (CityMapChar &cmap)
+{
+	for(vector<unsigned int>::const_iterator tile=cmap.liveTiles().begin(); tile!=cmap.liveTiles().end(); tile++)
+		for(short xx=0;xx<CITYTILE;xx++)
+			for(short yy=0;yy<CITYTILE;yy++)
+				if(cmap.tile(*tile)[xx][yy]=='o' || cmap.tile(*tile)[xx][yy]=='R')
+					cmap.tile(*tile)[xx][yy]='.';
+}
+
+void printCityMap (const CityMapChar &cmap)
 {
-	for(short yy=0;yy<CITYHEIGHT;yy++)
+	for(unsigned int yy=0;yy<CITYHEIGHT;yy++)
 	{
-		for(short xx=0;xx<CITYWIDTH;xx++)
-			cout << cmap.map[xx][yy] << ' ';
+		for(unsigned int xx=0;xx<CITYWIDTH;xx++)
+			cout << cmap.get(xx,yy) << ' ';
 		cout << '\n';
 	}
 }
 
-void printCityMap (CityMapNum cmap)
+void printCityMap (const CityMapNum &cmap)
 {
-	for(short yy=0;yy<CITYHEIGHT;yy++)
+	for(unsigned int yy=0;yy<CITYHEIGHT;yy++)
 	{
-		for(short xx=0;xx<CITYWIDTH;xx++)
-			if(cmap.map[xx][yy]>0) cout << cmap.map[xx][yy] << ' ';
+		for(unsigned int xx=0;xx<CITYWIDTH;xx++)
+			if(cmap.get(xx,yy)>0) cout << (int)cmap.get(xx,yy) << ' ';
 			else cout << "  ";
 		cout << '\n';
 	}
@@ -549,17 +815,62 @@ unsigned short getSignalQuality(unsigned short distance, bool lineOfSight)
 	return 0; 	// no signal
 }
 
+void computeCoverageStats(const CityMapBits &roads, const CityMapNum &signal, CoverageStats &stats)
+{
+	stats.roadCells = 0;
+	stats.coveredCells = 0;
+	stats.signalSum = 0;
+
+	// signal tiles, with the road bits of the same tile
+	for(vector<unsigned int>::const_iterator tile=signal.liveTiles().begin(); tile!=signal.liveTiles().end(); tile++)
+	{
+		const CityMapNum::Tile &cells = signal.tile(*tile);
+#if defined(__SSE2__) && CITYTILE==16
+		// 16 cells a row: zero cells from a byte compare, the sum from a sum of absolute differences to 0
+		static_assert(sizeof(cells[0][0])==1 && sizeof(cells[0])==16, "the SSE2 statistics pass reads a tile row as 16 bytes");
+		__m128i zero = _mm_setzero_si128();
+		__m128i sums = _mm_setzero_si128();
+		unsigned int zeroCells = 0;
+		for(short xx=0;xx<CITYTILE;xx++)
+		{
+			__m128i row = _mm_loadu_si128((const __m128i*)cells[xx].data());
+			zeroCells += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(row, zero)));
+			sums = _mm_add_epi64(sums, _mm_sad_epu8(row, zero));
+		}
+		stats.coveredCells += CITYTILE*CITYTILE - zeroCells;
+		stats.signalSum += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+#else
+		for(short xx=0;xx<CITYTILE;xx++)
+			for(short yy=0;yy<CITYTILE;yy++)
+			{
+				stats.coveredCells += cells[xx][yy]!=0;
+				stats.signalSum += cells[xx][yy];
+			}
+#endif
+		if(roads.hasTile(*tile))
+			for(short ww=0;ww<CITYTILEWORDS;ww++)
+				stats.roadCells += __builtin_popcountll(roads.tile(*tile)[ww]);
+	}
+
+	// road tiles nothing covers
+	for(vector<unsigned int>::const_iterator tile=roads.liveTiles().begin(); tile!=roads.liveTiles().end(); tile++)
+		if(!signal.hasTile(*tile))
+			for(short ww=0;ww<CITYTILEWORDS;ww++)
+				stats.roadCells += __builtin_popcountll(roads.tile(*tile)[ww]);
+}
+
 void applyCoverageToCityMap (RSU rsu, CityMapNum &city)
 {
 	for(short xx=0; xx<PARKEDCELLCOVERAGE; xx++)
 		for(short yy=0; yy<PARKEDCELLCOVERAGE; yy++)
 		{
-			short mapX=xx+rsu.xcell-PARKEDCELLRANGE;
-			short mapY=yy+rsu.ycell-PARKEDCELLRANGE;
+			int mapX=xx+rsu.xcell-PARKEDCELLRANGE;
+			int mapY=yy+rsu.ycell-PARKEDCELLRANGE;
+			if(mapX<0 || mapY<0) continue;	// off the map
 
 			// 'upgrade' coverage in a given cell if this RSU can cover it better
-			if(rsu.coverage[xx][yy] > city.map[mapX][mapY])
-				city.map[mapX][mapY] = rsu.coverage[xx][yy];
+			if(rsu.coverage[xx][yy] > city.get(mapX,mapY))
+				city.set(mapX, mapY, rsu.coverage[xx][yy]);
 		}
 }
 
@@ -629,13 +940,13 @@ void printListOfVehicles(list<Vehicle> &vehiclesOnGIS)
 //
 //
 //		for(std::vector<Vehicle>::iterator iter2=iter1->vehiclelist.begin(); iter2!=iter1->vehiclelist.end(); iter2++)
-//			if( isPointObstructed(conn,iter2->x,iter2->y) ) bumpcount++; else clearcount++;
+//			if( isPointObstructed(gis,iter2->x,iter2->y) ) bumpcount++; else clearcount++;
 //
 //	}
 //	cout << "bump " << bumpcount << " clear " << clearcount << endl;
 
 
-//	if(GIS_isLineOfSight(conn,-8.620598,41.164310,-8.619410,41.164179)) cout << "NLOS\n"; else cout << "LOS\n";
+//	if(GIS_isLineOfSight(gis,-8.620598,41.164310,-8.619410,41.164179)) cout << "NLOS\n"; else cout << "LOS\n";
 
 
 //	// DEBUG deltaSeconds
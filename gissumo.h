@@ -5,27 +5,34 @@
 #include <string>
 #include <vector>
 #include <array>
+#include <list>
+#include <unordered_map>
 #include <cmath>
+#include <stdint.h>
+#include <memory>
 
 #include <pqxx/pqxx>
 #include <boost/foreach.hpp>
 #include <boost/thread/thread.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
 #include <boost/program_options.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/bind.hpp>
+#include <boost/geometry.hpp>	// before the using directives below, it clashes with std
+#include <boost/geometry/geometries/point_xy.hpp>
+#include <boost/geometry/geometries/polygon.hpp>
+#include <boost/geometry/geometries/segment.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/index/rtree.hpp>
 
 using namespace std;
 using namespace boost;
-using namespace boost::property_tree;
 using namespace boost::program_options;
 
 
 /* Definitions
    ----------- */
 
-/* These are the top left origin points for our map, in WGS84 coordinates
+/* These are the top left origin points for our default map (Porto), in WGS84 coordinates
  * From pre-analysis of our map we've determined the limits to be:
  * Top Left: 41.16884 -8.622678			(29 cells Y)
  * Bottom Right: 41.160837 -8.609375	(48 cells X)
@@ -33,21 +40,46 @@ using namespace boost::program_options;
  * 6 seconds (6 cells) worth of margin were added to the following coordinates
  * (direction top left) to account for radio range.
  */
-#define YREFERENCE 41.17056 	// 41°10′14.0″N
-#define XREFERENCE -8.62444		// 008°37′28.0″W
+#define DEFAULT_YREFERENCE 41.17056 	// 41°10′14.0″N
+#define DEFAULT_XREFERENCE -8.62444		// 008°37′28.0″W
 
 // Map center coordinates
-#define YCENTER 41.163535
-#define XCENTER -8.617485
+#define DEFAULT_YCENTER 41.163535
+#define DEFAULT_XCENTER -8.617485
 
 // This is the coverage map size, in cells, of an RSU (e.g. '11' means 5 cell radius, RSU at center cell)
 #define PARKEDCELLCOVERAGE 11
 #define PARKEDCELLRANGE 5
 
-// The size of the city map in cells
+// The size of the default city map in cells
 // 6 cell margins were added (thus, +12 cells on each bearing)
-#define CITYHEIGHT 41	// yy
-#define CITYWIDTH 60	// xx
+#define DEFAULT_CITYHEIGHT 41	// yy
+#define DEFAULT_CITYWIDTH 60	// xx
+
+// RSU ids start here, clear of the interned vehicle slots they share packetSrc with
+// (and inside the integer id column of the GIS points table)
+#define RSUIDBASE 0x40000000u
+
+// Cells of margin kept around a map set at runtime, for radio range
+#define CITYMARGIN (PARKEDCELLRANGE+1)
+
+/* The city map in use, the default one unless set with --map-extent.
+ * Set once at startup, before any cell is worked out.
+ */
+struct CityExtent
+{
+	double xreference, yreference;	// top left corner
+	double xcenter, ycenter;
+	unsigned short width, height;	// in cells
+};
+extern CityExtent cityExtent;
+
+#define XREFERENCE (cityExtent.xreference)
+#define YREFERENCE (cityExtent.yreference)
+#define XCENTER (cityExtent.xcenter)
+#define YCENTER (cityExtent.ycenter)
+#define CITYWIDTH (cityExtent.width)
+#define CITYHEIGHT (cityExtent.height)
 
 /* At our location: 1" latitude: 30.89m; 1" longitude: 23.25m.
  * Ideally we would be using SRID 27492 which would give us equal axis, but that would require
@@ -65,6 +97,9 @@ using namespace boost::program_options;
 /* Functions
    --------- */
 
+// Sets cityExtent to cover (xmin,ymin)-(xmax,ymax) and a CITYMARGIN around it.
+void setCityExtent(double xmin, double ymin, double xmax, double ymax);
+
 // Given a WGS84 pair of coordinates, return an integer cell position.
 void determineCellFromWGS84 (float xgeo, float ygeo, unsigned short &xcell, unsigned short &ycell);
 
@@ -73,12 +108,19 @@ unsigned int deltaSeconds(float c1, float c2);
 
 // Prints a char CityMap to the terminal.
 class CityMapChar; class CityMapNum;
-void printCityMap (CityMapChar cmap);
-void printCityMap (CityMapNum cmap);
+void printCityMap (const CityMapChar &cmap);
+void printCityMap (const CityMapNum &cmap);
+
+// Turns the vehicle ('o') and RSU ('R') marks of a vehicle map into road ('.').
+void cleanVehicleMap (CityMapChar &cmap);
 
 // Returns the signal quality on a 1-5 scale based on distance and Line of Sight.
 unsigned short getSignalQuality(unsigned short distance, bool lineOfSight);
 
+// Works out road cells, covered cells and the signal sum in one pass over the live tiles of both maps.
+class CityMapBits; class CityMapNum; struct CoverageStats;
+void computeCoverageStats(const CityMapBits &roads, const CityMapNum &signal, CoverageStats &stats);
+
 // Applies the coverage map of an RSU to a global city map.
 class RSU; class CityMapNum;
 void applyCoverageToCityMap(RSU rsu, CityMapNum &city);
@@ -90,29 +132,141 @@ void printLocalCoverage(array< array<unsigned short,PARKEDCELLCOVERAGE>,PARKEDCE
 struct Vehicle;
 void printVehicleDetails(Vehicle veh);
 
-// Prints the list<Vehicle> of vehicles.
+// Prints the list of vehicles.
 void printListOfVehicles(list<Vehicle> &vehiclesOnGIS);
 
 
 /* Classes and Structs
    ------------------- */
 
+// Side of a city map tile, in cells
+#define CITYTILE 16
+
+/* A city map, (0,0) on Top Left, CITYWIDTH x CITYHEIGHT cells.
+ * Kept as CITYTILE x CITYTILE tiles, each allocated the first time one of its cells is set,
+ * so memory and scans over liveTiles() follow the cells in use (roads), not the bounding box.
+ * Cells never set, and cells of a tile past the map edge, hold the fill value.
+ */
+template<typename T> class TiledCityMap {
+public:
+	typedef array< array<T,CITYTILE>,CITYTILE > Tile;	// [x][y] from the tile's top left cell
+
+	TiledCityMap(T fill) : m_fill(fill), m_tilesWide((CITYWIDTH+CITYTILE-1)/CITYTILE),
+			m_tiles(m_tilesWide*((CITYHEIGHT+CITYTILE-1)/CITYTILE)) {}
+
+	// Returns a cell, the fill value for cells off the map.
+	T get(unsigned int x, unsigned int y) const
+	{
+		if(x>=CITYWIDTH || y>=CITYHEIGHT) return m_fill;
+		const Tile *tile = m_tiles[tileOf(x,y)].get();
+		return tile ? (*tile)[x%CITYTILE][y%CITYTILE] : m_fill;
+	}
+
+	// Sets a cell, allocating its tile if needed. Cells off the map are ignored.
+	void set(unsigned int x, unsigned int y, T value)
+	{
+		if(x>=CITYWIDTH || y>=CITYHEIGHT) return;
+		std::unique_ptr<Tile> &tile = m_tiles[tileOf(x,y)];
+		if(!tile)
+		{
+			tile.reset(new Tile);
+			for(int i=0; i<CITYTILE; i++) (*tile)[i].fill(m_fill);
+			m_live.push_back(tileOf(x,y));
+		}
+		(*tile)[x%CITYTILE][y%CITYTILE] = value;
+	}
+
+	// The tiles allocated so far, in the order they were allocated, as indexes for the functions below.
+	const vector<unsigned int>& liveTiles() const { return m_live; }
+
+	// Returns true if a tile has been allocated.
+	bool hasTile(unsigned int index) const { return m_tiles[index].get() != NULL; }
+
+	// The cells of a live tile.
+	Tile& tile(unsigned int index) { return *m_tiles[index]; }
+	const Tile& tile(unsigned int index) const { return *m_tiles[index]; }
+
+	// The top left cell of a tile.
+	unsigned short tileX(unsigned int index) const { return index%m_tilesWide*CITYTILE; }
+	unsigned short tileY(unsigned int index) const { return index/m_tilesWide*CITYTILE; }
+
+private:
+	T m_fill;
+	unsigned int m_tilesWide;
+	vector< std::unique_ptr<Tile> > m_tiles;	// by tile row, then column; NULL until touched
+	vector<unsigned int> m_live;
+
+	unsigned int tileOf(unsigned int x, unsigned int y) const { return y/CITYTILE*m_tilesWide + x/CITYTILE; }
+};
+
 // A char map to keep data for 2D visualization (terminal output)
-class CityMapChar {
+class CityMapChar : public TiledCityMap<char> {
 public:
-	array< array<char,CITYHEIGHT>,CITYWIDTH > map;	// city coverage map, (0,0) on Top Left
+	CityMapChar() : TiledCityMap<char>(' ') {}
+	CityMapChar(char fill) : TiledCityMap<char>(fill) {}
+};
 
-	CityMapChar() { for(int i=0; i<CITYWIDTH; i++) map[i].fill(' '); }
-	CityMapChar(char fill) { for(int i=0; i<CITYWIDTH; i++) map[i].fill(fill); }
+// A numeric map for keeping data in memory, such as coverage levels (0-5), one byte per cell
+class CityMapNum : public TiledCityMap<uint8_t> {
+public:
+	CityMapNum() : TiledCityMap<uint8_t>(0) {}
+	CityMapNum(uint8_t fill) : TiledCityMap<uint8_t>(fill) {}
 };
 
-// A numeric map for keeping data in memory, such as coverage levels
-class CityMapNum {
+/* One bit per city map cell, such as the cells vehicles have been on (roads).
+ * Tiles are numbered as in TiledCityMap, bit x*CITYTILE+y of a tile is its cell [x][y].
+ */
+#define CITYTILEWORDS (CITYTILE*CITYTILE/64)
+
+class CityMapBits {
 public:
-	array< array<int,CITYHEIGHT>,CITYWIDTH > map;	// city coverage map, (0,0) on Top Left
+	typedef array<uint64_t,CITYTILEWORDS> Tile;
+
+	CityMapBits() : m_tilesWide((CITYWIDTH+CITYTILE-1)/CITYTILE),
+			m_tiles(m_tilesWide*((CITYHEIGHT+CITYTILE-1)/CITYTILE)) {}
+
+	// Returns a cell's bit, false for cells off the map.
+	bool get(unsigned int x, unsigned int y) const
+	{
+		if(x>=CITYWIDTH || y>=CITYHEIGHT) return false;
+		const Tile *tile = m_tiles[tileOf(x,y)].get();
+		unsigned int bit = x%CITYTILE*CITYTILE + y%CITYTILE;
+		return tile && (((*tile)[bit/64] >> (bit%64)) & 1);
+	}
+
+	// Sets a cell's bit, allocating its tile if needed. Cells off the map are ignored.
+	void set(unsigned int x, unsigned int y)
+	{
+		if(x>=CITYWIDTH || y>=CITYHEIGHT) return;
+		std::unique_ptr<Tile> &tile = m_tiles[tileOf(x,y)];
+		if(!tile)
+		{
+			tile.reset(new Tile);
+			tile->fill(0);
+			m_live.push_back(tileOf(x,y));
+		}
+		unsigned int bit = x%CITYTILE*CITYTILE + y%CITYTILE;
+		(*tile)[bit/64] |= (uint64_t)1 << (bit%64);
+	}
+
+	const vector<unsigned int>& liveTiles() const { return m_live; }
+	bool hasTile(unsigned int index) const { return m_tiles[index].get() != NULL; }
+	const Tile& tile(unsigned int index) const { return *m_tiles[index]; }
+
+private:
+	unsigned int m_tilesWide;
+	vector< std::unique_ptr<Tile> > m_tiles;
+	vector<unsigned int> m_live;
+
+	unsigned int tileOf(unsigned int x, unsigned int y) const { return y/CITYTILE*m_tilesWide + x/CITYTILE; }
+};
 
-	CityMapNum() { for(int i=0; i<CITYWIDTH; i++) map[i].fill(0); }
-	CityMapNum(int fill) { for(int i=0; i<CITYWIDTH; i++) map[i].fill(fill); }
+// Coverage statistics of a signal map over the road cells, see computeCoverageStats().
+struct CoverageStats
+{
+	unsigned int roadCells;		// cells vehicles have been on
+	unsigned int coveredCells;	// cells with any signal
+	unsigned int signalSum;		// signal summed over every cell
 };
 
 
@@ -120,7 +274,7 @@ public:
  */
 struct Packet
 {
-	unsigned short packetSrc=0;
+	unsigned int packetSrc=0;
 	unsigned short packetID=0;
 	float packetTime=0;
 };
@@ -134,7 +288,7 @@ public:
 
 	// Characteristics and identifiers
 	RoadObjectType type;	// the type of this entity
-	unsigned short id;		// numeric identifier
+	unsigned int id;		// numeric identifier (vehicles: interned slot of the SUMO ID)
 	unsigned int gid;		// GIS numeric identifier
 	bool active;			// active status
 
@@ -171,12 +325,82 @@ public:
 };
 
 
-/* A timestep with a list of vehicles, for reading XML FCD data into.
+/* Interning table for SUMO vehicle IDs, which are strings (e.g. "flow0.123").
+ * Each distinct ID gets a dense slot number on first sight, used as the vehicle's id from then on.
+ */
+class VehicleIDTable {
+public:
+	// Returns the slot for sumoID, assigning the next free one if it's new.
+	unsigned int intern(const string &sumoID);
+
+	// Returns the SUMO ID of a slot.
+	const string& name(unsigned int slot) const { return m_names[slot]; }
+
+	// Number of slots handed out.
+	unsigned int size() const { return m_names.size(); }
+
+private:
+	std::unordered_map<string,unsigned int> m_slots;
+	vector<string> m_names;
+};
+
+
+/* The vehicles on GIS, with O(1) lookups by slot (id) and by GIS gid.
+ * List elements never move, so the lookup tables can hold plain pointers.
+ */
+class VehicleList : public list<Vehicle> {
+public:
+	VehicleList() : m_gidBase(0) {}
+
+	// Appends a vehicle, which already has its slot and gid, and indexes it. Returns the stored copy.
+	Vehicle* add(const Vehicle &veh);
+
+	// Return the vehicle with a given slot or gid, NULL if there's none.
+	Vehicle* bySlot(unsigned int slot) const { return slot<m_slots.size() ? m_slots[slot] : NULL; }
+	Vehicle* byGID(unsigned int gid) const
+		{ return (gid>=m_gidBase && gid-m_gidBase<m_gids.size()) ? m_gids[gid-m_gidBase] : NULL; }
+
+private:
+	vector<Vehicle*> m_slots;
+	vector<Vehicle*> m_gids;	// gids come from a database sequence, so they're dense past the first one seen
+	unsigned int m_gidBase;
+};
+
+
+/* One FCD sample of a loaded trace. Vehicle carries simulation state (GIS, network, parking)
+ * that a raw sample doesn't need, this is a fraction of its size.
+ * Coordinates are fixed point in 1e-7 degrees (about 1cm here), finer than Vehicle's floats
+ * when quantized from the XML's doubles (binary traces only store floats).
+ */
+#define TRACE_COORDSCALE 1e7	// fixed point units per degree
+#define TRACE_SPEEDSCALE 100	// fixed point units per m/s
+
+struct TraceRecord
+{
+	uint32_t id;		// interned vehicle slot
+	int32_t xfix;		// x,y geographic position, fixed point
+	int32_t yfix;
+	uint16_t xcell;		// x,y position in a cell map
+	uint16_t ycell;
+	uint16_t speedfix;	// vehicle speed, fixed point
+
+	void setPosition(double xgeo, double ygeo)
+		{ xfix = lround(xgeo*TRACE_COORDSCALE); yfix = lround(ygeo*TRACE_COORDSCALE); }
+	void setSpeed(float speed)
+		{ speedfix = speed<=0 ? 0 : (uint16_t) min(lround(speed*TRACE_SPEEDSCALE), 65535L); }
+
+	float xgeo() const { return xfix/TRACE_COORDSCALE; }
+	float ygeo() const { return yfix/TRACE_COORDSCALE; }
+	float speed() const { return speedfix/(float)TRACE_SPEEDSCALE; }
+};
+
+
+/* A timestep with its FCD samples, for reading XML FCD data into.
  */
 struct Timestep
 {
 	float time = 0;
-	std::vector<Vehicle> vehiclelist;
+	std::vector<TraceRecord> records;
 };
 
 
@@ -6,7 +6,7 @@ map<float,int> s_packetPropagationTime;
 extern bool m_debug;
 extern bool m_rsu;
 
-void processNetwork(pqxx::connection &conn, float timestep, list<Vehicle> &vehiclesOnGIS, list<RSU> &rsuList)
+void processNetwork(GISBackend &gis, float timestep, VehicleList &vehiclesOnGIS, list<RSU> &rsuList)
 {
 	if(m_debug) cout << "DEBUG processNetwork" << " timestep " << timestep << " RSUs " << (m_rsu?"enabled":"disabled")<< endl;
 
@@ -20,9 +20,32 @@ void processNetwork(pqxx::connection &conn, float timestep, list<Vehicle> &vehic
 	 */
 	// We need to differentiate new broadcasts (source isn't an SCF) and run the gift-wrapping algorithm, from
 	// messages received from an SCF (don't rebroadcast).
+	vector<Vehicle*> carriers;
 	for(list<Vehicle>::iterator iterVehicle=vehiclesOnGIS.begin(); iterVehicle!=vehiclesOnGIS.end(); iterVehicle++)
 		if(iterVehicle->scf)
-			rebroadcastPacket(conn, timestep, vehiclesOnGIS, rsuList, &(*iterVehicle) );
+			carriers.push_back(&(*iterVehicle));
+
+	/* Who a carrier reaches depends on positions only, not on who got the packet before it,
+	 * so with a connection pool every carrier's neighbors are looked up in parallel first.
+	 * Delivery then runs in the same order as before.
+	 */
+	if(gisPool && !m_debug && carriers.size()>1)
+	{
+		vector< vector<Vehicle*> > neighbors(carriers.size());
+		vector< vector<RSU*> > RSUneighbors(carriers.size());
+		gisPool->parallelFor(carriers.size(), boost::bind(findNeighborsTask, &vehiclesOnGIS, &rsuList, &carriers, &neighbors, &RSUneighbors, _1, _2));
+
+		for(size_t carrier=0; carrier<carriers.size(); carrier++)
+			deliverPacket(timestep, carriers[carrier], neighbors[carrier], RSUneighbors[carrier]);
+	}
+	else
+	{
+		// with pipelining, all lookups are on their way before the first is waited on
+		for(vector<Vehicle*>::iterator carrier=carriers.begin(); carrier!=carriers.end(); carrier++)
+			GIS_prefetchNeighbors((*carrier)->xgeo, (*carrier)->ygeo, MAXRANGE);
+		for(vector<Vehicle*>::iterator carrier=carriers.begin(); carrier!=carriers.end(); carrier++)
+			rebroadcastPacket(gis, timestep, vehiclesOnGIS, rsuList, *carrier);
+	}
 
 
 	/* RSUs with packets rebroadcast their message as well and trigger UVCAST (new source points).
@@ -30,7 +53,7 @@ void processNetwork(pqxx::connection &conn, float timestep, list<Vehicle> &vehic
 	if(m_rsu)
 		for(list<RSU>::iterator iterRSU=rsuList.begin(); iterRSU!=rsuList.end(); iterRSU++)
 			if(iterRSU->packet.packetID)
-				initialBroadcast(conn, timestep, vehiclesOnGIS, rsuList, &(*iterRSU), &(*iterRSU));
+				initialBroadcast(gis, timestep, vehiclesOnGIS, rsuList, &(*iterRSU), &(*iterRSU));
 
 	// All RSUs share the same packet. This could be improved.
 	if(m_rsu)
@@ -42,13 +65,33 @@ void processNetwork(pqxx::connection &conn, float timestep, list<Vehicle> &vehic
 }
 
 
-void rebroadcastPacket(pqxx::connection &conn, float timestep, list<Vehicle> &vehiclesOnGIS, list<RSU> &rsuList, Vehicle *veh)
+void rebroadcastPacket(GISBackend &gis, float timestep, VehicleList &vehiclesOnGIS, list<RSU> &rsuList, Vehicle *veh)
 {
 	// Get our neighbor list. This routine already returns vehicles where communication is possible (signal>=2)
-	vector<Vehicle*> neighbors = getVehiclesInRange(conn, vehiclesOnGIS, *veh);
+	vector<Vehicle*> neighbors = getVehiclesInRange(gis, vehiclesOnGIS, *veh);
+
+	// get our RSU neighbor list
+	vector<RSU*> RSUneighbors;
+	if(m_rsu)
+		RSUneighbors = getRSUsInRange(gis, rsuList, *veh);
+
+	deliverPacket(timestep, veh, neighbors, RSUneighbors);
+}
 
+
+void findNeighborsTask(VehicleList *vehiclesOnGIS, list<RSU> *rsuList, const vector<Vehicle*> *carriers,
+		vector< vector<Vehicle*> > *neighbors, vector< vector<RSU*> > *RSUneighbors, GISBackend &gis, size_t i)
+{
+	(*neighbors)[i] = getVehiclesInRange(gis, *vehiclesOnGIS, *(*carriers)[i]);
+	if(m_rsu)
+		(*RSUneighbors)[i] = getRSUsInRange(gis, *rsuList, *(*carriers)[i]);
+}
+
+
+void deliverPacket(float timestep, Vehicle *veh, const vector<Vehicle*> &neighbors, const vector<RSU*> &RSUneighbors)
+{
 	// Go through each neighbor. If the packet isn't the same as ours, send our packet to them.
-	for(vector<Vehicle*>::iterator iter=neighbors.begin(); iter!=neighbors.end(); iter++)
+	for(vector<Vehicle*>::const_iterator iter=neighbors.begin(); iter!=neighbors.end(); iter++)
 		if( (*iter)->packet.packetID != veh->packet.packetID )
 			{
 				(*iter)->packet.packetID = veh->packet.packetID;
@@ -66,10 +109,8 @@ void rebroadcastPacket(pqxx::connection &conn, float timestep, list<Vehicle> &ve
 
 	if(m_rsu)
 	{
-		// get our RSU neighbor list
-		vector<RSU*> RSUneighbors = getRSUsInRange(conn, rsuList, *veh);
 		// Go through each RSU. If the packet isn't the same as ours, send our packet to it.
-		for(vector<RSU*>::iterator iter=RSUneighbors.begin(); iter!=RSUneighbors.end(); iter++)
+		for(vector<RSU*>::const_iterator iter=RSUneighbors.begin(); iter!=RSUneighbors.end(); iter++)
 			if( (*iter)->packet.packetID != veh->packet.packetID )
 				{
 					(*iter)->packet.packetID = veh->packet.packetID;
@@ -87,7 +128,7 @@ void rebroadcastPacket(pqxx::connection &conn, float timestep, list<Vehicle> &ve
 	}
 }
 
-void simulateAccident(pqxx::connection &conn, float timestep, list<Vehicle> &vehiclesOnGIS, list<RSU> &rsuList, Vehicle* accidentSource)
+void simulateAccident(GISBackend &gis, float timestep, VehicleList &vehiclesOnGIS, list<RSU> &rsuList, Vehicle* accidentSource)
 {
 	if(m_debug)
 		cout << "DEBUG simulateAccident"
@@ -101,10 +142,10 @@ void simulateAccident(pqxx::connection &conn, float timestep, list<Vehicle> &veh
 	accidentSource->packet.packetTime = timestep;
 
 	// Get the message going
-	initialBroadcast(conn, timestep, vehiclesOnGIS, rsuList, accidentSource, accidentSource);
+	initialBroadcast(gis, timestep, vehiclesOnGIS, rsuList, accidentSource, accidentSource);
 }
 
-void initialBroadcast(pqxx::connection &conn, float timestep, list<Vehicle> &vehiclesOnGIS, list<RSU> &rsuList, RoadObject* selfVeh, RoadObject* srcVeh)
+void initialBroadcast(GISBackend &gis, float timestep, VehicleList &vehiclesOnGIS, list<RSU> &rsuList, RoadObject* selfVeh, RoadObject* srcVeh)
 {
 	/* This is a recursive function.
 	 * Make sure that the vehicle on the first call has a packet.
@@ -116,12 +157,22 @@ void initialBroadcast(pqxx::connection &conn, float timestep, list<Vehicle> &veh
 				<< endl;
 
 	// We get our neighbors.
-	vector<Vehicle*> neighbors = getVehiclesInRange(conn, vehiclesOnGIS, *selfVeh);
+	vector<Vehicle*> neighbors = getVehiclesInRange(gis, vehiclesOnGIS, *selfVeh);
 
 	// We broadcast the packet. Those who don't have the packet already get initialBroadcast() called on them too.
 	for(vector<Vehicle*>::iterator iter=neighbors.begin(); iter!=neighbors.end(); iter++)
 		if((*iter)->packet.packetID != selfVeh->packet.packetID)
 		{
+			/* This neighbor looks up its own neighbors first thing. Send that query, and the one of
+			 * the next neighbor still without our packet, which then runs while this one recurses.
+			 * Only one query goes ahead of the neighbor being served, not one per neighbor: any of them
+			 * may get the packet deeper in the recursion and be skipped here.
+			 */
+			GIS_prefetchNeighbors((*iter)->xgeo, (*iter)->ygeo, MAXRANGE);
+			for(vector<Vehicle*>::iterator next=iter+1; next!=neighbors.end(); next++)
+				if((*next)->packet.packetID != selfVeh->packet.packetID)
+					{ GIS_prefetchNeighbors((*next)->xgeo, (*next)->ygeo, MAXRANGE); break; }
+
 			// Neighbor doesn't have our packet. Give it, and stat.
 			(*iter)->packet.packetID = selfVeh->packet.packetID;
 			(*iter)->packet.packetSrc = selfVeh->id;
@@ -130,7 +181,7 @@ void initialBroadcast(pqxx::connection &conn, float timestep, list<Vehicle> &veh
 			s_packetPropagationTime[timestep]++;
 
 			// Do initialBroadcast on it.
-			initialBroadcast(conn, timestep, vehiclesOnGIS, rsuList, *iter, selfVeh);
+			initialBroadcast(gis, timestep, vehiclesOnGIS, rsuList, *iter, selfVeh);
 		}
 
 	if(m_rsu)
@@ -138,7 +189,7 @@ void initialBroadcast(pqxx::connection &conn, float timestep, list<Vehicle> &veh
 		/* Get RSU neighbors and pass the message on to them. Don't call InitialBroadcast on RSUs.
 		 */
 		// Get our RSU neighbor list
-		vector<RSU*> RSUneighbors = getRSUsInRange(conn, rsuList, *selfVeh);
+		vector<RSU*> RSUneighbors = getRSUsInRange(gis, rsuList, *selfVeh);
 		// Go through each RSU. If the packet isn't the same as ours, send our packet to it.
 		for(vector<RSU*>::iterator iter=RSUneighbors.begin(); iter!=RSUneighbors.end(); iter++)
 			if( (*iter)->packet.packetID != selfVeh->packet.packetID )
@@ -7,15 +7,22 @@
 #include "uvcast.h"
 
 // Called from main, handles the transmission of packets.
-void processNetwork(pqxx::connection &conn, float timestep, list<Vehicle> &vehiclesOnGIS, list<RSU> &rsuList);
+void processNetwork(GISBackend &gis, float timestep, VehicleList &vehiclesOnGIS, list<RSU> &rsuList);
 
 // Vehicle veh sends its message to all neighbors.
-void rebroadcastPacket(pqxx::connection &conn, float timestep, list<Vehicle> &vehiclesOnGIS, list<RSU> &rsuList, Vehicle *veh);
+void rebroadcastPacket(GISBackend &gis, float timestep, VehicleList &vehiclesOnGIS, list<RSU> &rsuList, Vehicle *veh);
+
+// Looks up the vehicle and RSU neighbors of (*carriers)[i] (parallelFor() task).
+void findNeighborsTask(VehicleList *vehiclesOnGIS, list<RSU> *rsuList, const vector<Vehicle*> *carriers,
+		vector< vector<Vehicle*> > *neighbors, vector< vector<RSU*> > *RSUneighbors, GISBackend &gis, size_t i);
+
+// Vehicle veh sends its message to the given neighbors.
+void deliverPacket(float timestep, Vehicle *veh, const vector<Vehicle*> &neighbors, const vector<RSU*> &RSUneighbors);
 
 // Simulates an accident on Vehicle accidentSource, gets UVCAST going.
-void simulateAccident(pqxx::connection &conn, float timestep, list<Vehicle> &vehiclesOnGIS, list<RSU> &rsuList, Vehicle* accidentSource);
+void simulateAccident(GISBackend &gis, float timestep, VehicleList &vehiclesOnGIS, list<RSU> &rsuList, Vehicle* accidentSource);
 
 // An initial broadcast is recursive, and will call itself for all vehicles that are part of a cluster.
-void initialBroadcast(pqxx::connection &conn, float timestep, list<Vehicle> &vehiclesOnGIS, list<RSU> &rsuList, RoadObject* selfVeh, RoadObject* srcVeh);
+void initialBroadcast(GISBackend &gis, float timestep, VehicleList &vehiclesOnGIS, list<RSU> &rsuList, RoadObject* selfVeh, RoadObject* srcVeh);
 
 #endif /* NETWORK_H_ */
@@ -0,0 +1,131 @@
+#include "placement.h"
+#include "gis.h"
+#include "coverage.h"
+
+
+void RSUPlacement::addTimestep(const Timestep &t)
+{
+	for(vector<TraceRecord>::const_iterator iter=t.records.begin(); iter!=t.records.end(); iter++)
+	{
+		// points west or north of the reference corner fold back onto the map, see FCDFilter::accepts
+		if(iter->xgeo()<XREFERENCE || iter->ygeo()>YREFERENCE || iter->xcell>=CITYWIDTH || iter->ycell>=CITYHEIGHT)
+			continue;
+
+		uint32_t occupancy = m_occupancy.get(iter->xcell, iter->ycell);
+		if(!occupancy) m_candidates.push_back(*iter);
+		m_occupancy.set(iter->xcell, iter->ycell, occupancy+1);
+		m_vehicleTimesteps++;
+	}
+}
+
+
+void RSUPlacement::evaluate(GISBackend &gis, unsigned int threads)
+{
+	// an RSU inside a building would see nothing
+	vector<char> obstructed;
+	GIS_pointsObstructed(gis, m_candidates, obstructed);
+	vector<TraceRecord> clear;
+	for(size_t i=0; i<m_candidates.size(); i++)
+		if(!obstructed[i]) clear.push_back(m_candidates[i]);
+	if(m_debug) cout << "DEBUG RSU placement: " << m_candidates.size()-clear.size() << " of "
+			<< m_candidates.size() << " candidates obstructed" << endl;
+	m_candidates.swap(clear);
+
+	m_coverage.assign(m_candidates.size(), vector<CellSignal>());
+	m_gain.assign(m_candidates.size(), 0);
+
+	// candidates are dealt out round robin, each writes only its own slots
+	if(!threads) threads = 1;
+	boost::thread_group workers;
+	for(unsigned int thread=0; thread<threads; thread++)
+		workers.create_thread(boost::bind(&RSUPlacement::evaluateStride, this, &gis, thread, threads));
+	workers.join_all();
+
+	if(m_debug) cout << "DEBUG RSU placement: evaluated " << m_candidates.size() << " candidates on " << threads << " threads" << endl;
+}
+
+
+void RSUPlacement::evaluateStride(GISBackend *gis, size_t first, size_t step)
+{
+	for(size_t i=first; i<m_candidates.size(); i+=step)
+	{
+		RSU rsu;
+		rsu.id = RSUIDBASE+i;
+		rsu.xgeo = m_candidates[i].xgeo();
+		rsu.ygeo = m_candidates[i].ygeo();
+		rsu.xcell = m_candidates[i].xcell;
+		rsu.ycell = m_candidates[i].ycell;
+		computeStaticCoverage(*gis, rsu);
+
+		// only road cells count
+		for(short xx=0; xx<PARKEDCELLCOVERAGE; xx++)
+			for(short yy=0; yy<PARKEDCELLCOVERAGE; yy++)
+			{
+				if(!rsu.coverage[xx][yy]) continue;
+				int xcell = rsu.xcell + xx - PARKEDCELLRANGE;
+				int ycell = rsu.ycell + yy - PARKEDCELLRANGE;
+				if(xcell<0 || ycell<0) continue;	// off the map
+				uint32_t weight = m_occupancy.get(xcell, ycell);
+				if(!weight) continue;
+
+				CellSignal cell = { (uint16_t)xcell, (uint16_t)ycell, (uint8_t)rsu.coverage[xx][yy], weight };
+				m_coverage[i].push_back(cell);
+				m_gain[i] += (uint64_t)weight*cell.signal;
+			}
+	}
+}
+
+
+uint64_t RSUPlacement::gainOver(size_t candidate, const CityMapNum &best) const
+{
+	uint64_t gain = 0;
+	for(vector<CellSignal>::const_iterator iter=m_coverage[candidate].begin(); iter!=m_coverage[candidate].end(); iter++)
+	{
+		uint8_t current = best.get(iter->xcell, iter->ycell);
+		if(iter->signal > current)
+			gain += (uint64_t)iter->weight*(iter->signal - current);
+	}
+	return gain;
+}
+
+
+vector<RSUSite> RSUPlacement::select(unsigned int count)
+{
+	vector<RSUSite> sites;
+	CityMapNum best;		// signal from the best site picked so far, per cell
+
+	// candidates by gain; a gain in the queue may be stale, but never lower than the current one
+	std::priority_queue< std::pair<uint64_t,size_t> > queue;
+	for(size_t i=0; i<m_candidates.size(); i++)
+		if(m_gain[i]) queue.push(std::make_pair(m_gain[i], i));
+
+	while(sites.size()<count && !queue.empty())
+	{
+		size_t candidate = queue.top().second;
+		queue.pop();
+		uint64_t gain = gainOver(candidate, best);
+		if(!gain) continue;
+
+		// no other candidate can beat it if it still beats the next one's bound
+		if(!queue.empty() && gain < queue.top().first)
+		{
+			queue.push(std::make_pair(gain, candidate));
+			continue;
+		}
+
+		RSUSite site;
+		site.xgeo = m_candidates[candidate].xgeo();
+		site.ygeo = m_candidates[candidate].ygeo();
+		site.gain = gain;
+		site.cellsCovered = 0;
+		for(vector<CellSignal>::const_iterator iter=m_coverage[candidate].begin(); iter!=m_coverage[candidate].end(); iter++)
+			if(iter->signal > best.get(iter->xcell, iter->ycell))
+			{
+				best.set(iter->xcell, iter->ycell, iter->signal);
+				site.cellsCovered++;
+			}
+		sites.push_back(site);
+	}
+
+	return sites;
+}
@@ -0,0 +1,70 @@
+#ifndef PLACEMENT_H_
+#define PLACEMENT_H_
+
+#include <queue>
+#include "gissumo.h"
+#include "gisbackend.h"
+extern bool m_debug;
+
+
+/* RSU placement: picks the sites for a number of RSUs that give the vehicles of a trace
+ * the best signal.
+ *
+ * Candidate sites are road cells, at the first position a vehicle was seen in each, less
+ * the ones inside a feature (as GIS_pointsObstructed() tells, an RSU there would see
+ * nothing). A candidate's coverage is the one --static-coverage gives an RSU there, and
+ * only counts in cells vehicles were in, weighted by how many vehicle timesteps were
+ * spent in them. The score of a set of sites is the weighted signal each cell gets from
+ * its best site. Adding a site never helps a larger set more than a smaller one, so sites
+ * are picked greedily, and a candidate's gain is only worked out again when it comes up
+ * as the best one (lazy greedy), which picks the same sites as plain greedy.
+ */
+struct RSUSite
+{
+	float xgeo, ygeo;
+	uint64_t gain;				// weighted signal added by this site, over the ones before it
+	unsigned int cellsCovered;	// road cells this site is the best signal of, when picked
+};
+
+class RSUPlacement {
+public:
+	RSUPlacement() : m_occupancy(0), m_vehicleTimesteps(0) {}
+
+	// Counts a timestep's vehicles into the road cells, making a candidate of every new cell.
+	void addTimestep(const Timestep &t);
+
+	// Drops obstructed candidates and works out the coverage of the others, on 'threads' threads.
+	// Line of sight must be answered in memory (buildings or visibility), the backend is shared.
+	void evaluate(GISBackend &gis, unsigned int threads);
+
+	// Picks up to 'count' sites, fewer if no candidate adds anything.
+	vector<RSUSite> select(unsigned int count);
+
+	size_t candidates() const { return m_candidates.size(); }
+
+	// Vehicle timesteps counted, the most weight a site could cover per signal level.
+	uint64_t vehicleTimesteps() const { return m_vehicleTimesteps; }
+
+private:
+	// A road cell a candidate reaches.
+	struct CellSignal
+	{
+		uint16_t xcell, ycell;
+		uint8_t signal;
+		uint32_t weight;		// vehicle timesteps in the cell
+	};
+
+	TiledCityMap<uint32_t> m_occupancy;		// vehicle timesteps per road cell
+	uint64_t m_vehicleTimesteps;
+	vector<TraceRecord> m_candidates;			// first position seen in each road cell
+	vector< vector<CellSignal> > m_coverage;	// per candidate
+	vector<uint64_t> m_gain;					// per candidate, over no sites at all
+
+	// Works out candidates first, first+step, ... (worker thread body).
+	void evaluateStride(GISBackend *gis, size_t first, size_t step);
+
+	// Weighted signal a candidate adds over the best signal in each cell so far.
+	uint64_t gainOver(size_t candidate, const CityMapNum &best) const;
+};
+
+#endif /* PLACEMENT_H_ */
@@ -0,0 +1,98 @@
+#include "pointgrid.h"
+
+PointGrid gisPoints;
+
+const PointGrid::GridPoint* PointGrid::find(unsigned int gid) const
+{
+	if(gid < m_gidBase || gid-m_gidBase >= m_points.size() || !m_points[gid-m_gidBase].used)
+		return NULL;
+	return &m_points[gid-m_gidBase];
+}
+
+
+void PointGrid::set(unsigned int gid, float xgeo, float ygeo)
+{
+	// the first gid sets the base, gids below it (none expected) shift everything up
+	if(m_points.empty())
+		m_gidBase = gid;
+	else if(gid < m_gidBase)
+	{
+		GridPoint unused = { false, 0, 0, 0, 0 };
+		m_points.insert(m_points.begin(), m_gidBase-gid, unused);
+		m_gidBase = gid;
+	}
+	if(gid-m_gidBase >= m_points.size())
+	{
+		GridPoint unused = { false, 0, 0, 0, 0 };
+		m_points.resize(gid-m_gidBase+1, unused);
+	}
+
+	GridPoint &point = m_points[gid-m_gidBase];
+	uint64_t cell = cellKey(cellOf(xgeo), cellOf(ygeo));
+
+	// take the point out of its old cell, moving that cell's last point into its place
+	if(point.used && point.cell != cell)
+	{
+		vector<unsigned int> &old = m_cells[point.cell];
+		old[point.slot] = old.back();
+		m_points[old.back()-m_gidBase].slot = point.slot;
+		old.pop_back();
+		if(old.empty()) m_cells.erase(point.cell);
+	}
+	if(!point.used || point.cell != cell)
+	{
+		vector<unsigned int> &bucket = m_cells[cell];
+		point.slot = bucket.size();
+		bucket.push_back(gid);
+	}
+
+	point.used = true;
+	point.xgeo = xgeo;
+	point.ygeo = ygeo;
+	point.cell = cell;
+}
+
+
+bool PointGrid::coords(unsigned int gid, float &xgeo, float &ygeo) const
+{
+	const GridPoint *point = find(gid);
+	if(!point) return false;
+	xgeo = point->xgeo;
+	ygeo = point->ygeo;
+	return true;
+}
+
+
+vector<unsigned int> PointGrid::inRange(float xcenter, float ycenter, float range) const
+{
+	vector<unsigned int> neighbors;
+	double range2 = (double)range*range;
+
+	for(int32_t x=cellOf(xcenter-range); x<=cellOf(xcenter+range); x++)
+		for(int32_t y=cellOf(ycenter-range); y<=cellOf(ycenter+range); y++)
+		{
+			std::unordered_map< uint64_t, vector<unsigned int> >::const_iterator cell = m_cells.find(cellKey(x,y));
+			if(cell == m_cells.end()) continue;
+
+			for(vector<unsigned int>::const_iterator iter=cell->second.begin(); iter != cell->second.end(); iter++)
+			{
+				const GridPoint &point = m_points[*iter-m_gidBase];
+				double dx = (double)point.xgeo - xcenter;
+				double dy = (double)point.ygeo - ycenter;
+				if(dx*dx + dy*dy <= range2)
+					neighbors.push_back(*iter);
+			}
+		}
+
+	// cells come out in hash order, give callers a stable one
+	sort(neighbors.begin(), neighbors.end());
+	return neighbors;
+}
+
+
+void PointGrid::clear()
+{
+	m_points.clear();
+	m_cells.clear();
+	m_gidBase = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef POINTGRID_H_
+#define POINTGRID_H_
+
+#include "gissumo.h"
+extern bool m_debug;
+
+// Side of a grid cell in degrees, one WGS84 second like the city map cells.
+#define POINTGRID_CELLSIZE (1.0/3600)
+
+
+/* Vehicle and RSU positions (the points mirrored to GIS_POINTSTABLE), bucketed in a uniform grid.
+ * Range queries look at the few cells around the center only, and measure distance
+ * in degrees on the plane, as ST_DWithin does on SRID 4326 geometries.
+ * Points are known by their gid, handed out here or by the database.
+ */
+class PointGrid {
+public:
+	PointGrid() : m_nextGID(1), m_gidBase(0) {}
+
+	// Returns a gid that hasn't been used yet, for points that aren't in the database.
+	unsigned int newGID() { return m_nextGID++; }
+
+	// Adds a point, or moves it if it's already there.
+	void set(unsigned int gid, float xgeo, float ygeo);
+
+	// Returns false if the point isn't there.
+	bool coords(unsigned int gid, float &xgeo, float &ygeo) const;
+
+	// Returns the gids of all points within 'range' degrees of (xcenter,ycenter), in gid order.
+	vector<unsigned int> inRange(float xcenter, float ycenter, float range) const;
+
+	// Removes every point.
+	void clear();
+
+private:
+	struct GridPoint
+	{
+		bool used;
+		float xgeo, ygeo;
+		uint64_t cell;		// key of the cell holding the point
+		unsigned int slot;	// position in that cell's list
+	};
+
+	unsigned int m_nextGID;
+	unsigned int m_gidBase;				// gid of m_points[0], database gids don't start at 0
+	vector<GridPoint> m_points;			// by gid
+	std::unordered_map< uint64_t, vector<unsigned int> > m_cells;	// gids in each cell
+
+	// Returns the grid coordinate of a longitude or latitude.
+	static int32_t cellOf(double coordinate) { return (int32_t) floor(coordinate/POINTGRID_CELLSIZE); }
+
+	// Packs grid coordinates into a cell key.
+	static uint64_t cellKey(int32_t x, int32_t y) { return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y; }
+
+	// Returns the entry of a gid, or NULL if it's not there.
+	const GridPoint* find(unsigned int gid) const;
+};
+
+// Positions of every vehicle and RSU added through GIS_addPoint().
+extern PointGrid gisPoints;
+
+#endif /* POINTGRID_H_ */
@@ -0,0 +1,109 @@
+#include "visibility.h"
+
+VisibilityMatrix gisVisibility;
+
+// Refuses a map whose matrix would take more than VISIBILITY_MAXBYTES.
+static void checkSize()
+{
+	if(VisibilityMatrix::bytes() > VISIBILITY_MAXBYTES)
+		{ cerr << "ERROR: A visibility matrix for a " << CITYWIDTH << 'x' << CITYHEIGHT << " cell map would take "
+				<< VisibilityMatrix::bytes()/(1<<20) << " MB, more than " << VISIBILITY_MAXBYTES/(1<<20)
+				<< " MB. Use a smaller --map-extent." << endl; exit(1); }
+}
+
+// Coordinates of a cell's center.
+static void cellCenter(unsigned int cell, float &xgeo, float &ygeo)
+{
+	xgeo = XREFERENCE + (cell%CITYWIDTH + 0.5)/3600;
+	ygeo = YREFERENCE - (cell/CITYWIDTH + 0.5)/3600;
+}
+
+
+void VisibilityMatrix::buildRows(const BuildingIndex *buildings, unsigned int first, unsigned int step)
+{
+	for(unsigned int from=first; from<VISIBILITY_CELLS; from+=step)
+	{
+		float x1, y1;
+		cellCenter(from, x1, y1);
+		uint64_t *row = &m_bits[from*m_stride];
+
+		for(unsigned int to=from; to<VISIBILITY_CELLS; to++)
+		{
+			float x2, y2;
+			cellCenter(to, x2, y2);
+			if(!buildings->intersects(x1,y1,x2,y2))
+				row[to/64] |= (uint64_t)1 << (to%64);
+		}
+	}
+}
+
+
+void VisibilityMatrix::build(const BuildingIndex &buildings, unsigned int threads)
+{
+	if(!threads) threads = 1;
+	checkSize();
+	m_stride = (VISIBILITY_CELLS+63)/64;
+	m_bits.assign(VISIBILITY_CELLS*m_stride, 0);
+
+	// rows are dealt out round robin, as the triangle gets shorter towards the end
+	boost::thread_group workers;
+	for(unsigned int thread=0; thread<threads; thread++)
+		workers.create_thread(boost::bind(&VisibilityMatrix::buildRows, this, &buildings, thread, threads));
+	workers.join_all();
+
+	// line of sight goes both ways, copy the upper triangle down
+	for(unsigned int from=0; from<VISIBILITY_CELLS; from++)
+		for(unsigned int to=0; to<from; to++)
+			if((m_bits[to*m_stride + from/64] >> (from%64)) & 1)
+				m_bits[from*m_stride + to/64] |= (uint64_t)1 << (to%64);
+
+	m_loaded = true;
+	if(m_debug) cout << "DEBUG Built visibility for " << VISIBILITY_CELLS << " cells on " << threads << " threads" << endl;
+}
+
+
+void VisibilityMatrix::save(const string &filename) const
+{
+	VisibilityHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, VISIBILITY_MAGIC, sizeof(header.magic));
+	header.version = VISIBILITY_VERSION;
+	header.width = CITYWIDTH;
+	header.height = CITYHEIGHT;
+	header.stride = m_stride;
+	header.xreference = XREFERENCE;
+	header.yreference = YREFERENCE;
+
+	ofstream out(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(&m_bits[0]), m_bits.size()*sizeof(uint64_t));
+	out.close();
+	if(out.fail())
+		{ cerr << "ERROR: Could not write visibility matrix " << filename << endl; exit(1); }
+
+	if(m_debug) cout << "DEBUG Wrote visibility matrix to " << filename << endl;
+}
+
+
+void VisibilityMatrix::load(const string &filename)
+{
+	ifstream in(filename.c_str(), ios::in | ios::binary);
+	if(!in.is_open())
+		{ cerr << "ERROR: Could not open visibility matrix " << filename << endl; exit(1); }
+
+	checkSize();
+	m_stride = (VISIBILITY_CELLS+63)/64;
+	VisibilityHeader header;
+	if(!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, VISIBILITY_MAGIC, sizeof(header.magic)))
+		{ cerr << "ERROR: " << filename << " is not a visibility matrix" << endl; exit(1); }
+	if(header.version!=VISIBILITY_VERSION || header.width!=CITYWIDTH || header.height!=CITYHEIGHT || header.stride!=m_stride
+			|| header.xreference!=XREFERENCE || header.yreference!=YREFERENCE)
+		{ cerr << "ERROR: Visibility matrix " << filename << " was built for a different map, rebuild it" << endl; exit(1); }
+
+	m_bits.resize(VISIBILITY_CELLS*m_stride);
+	if(!in.read(reinterpret_cast<char*>(&m_bits[0]), m_bits.size()*sizeof(uint64_t)))
+		{ cerr << "ERROR: Visibility matrix " << filename << " is truncated" << endl; exit(1); }
+
+	m_loaded = true;
+	if(m_debug) cout << "DEBUG Loaded visibility matrix " << filename << endl;
+}
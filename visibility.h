@@ -0,0 +1,71 @@
+#ifndef VISIBILITY_H_
+#define VISIBILITY_H_
+
+#include <fstream>
+#include <cstring>
+#include "gissumo.h"
+#include "buildings.h"
+extern bool m_debug;
+
+
+/* Line of sight between every pair of city map cells, one bit per pair, taken between
+ * cell centers. Built once per map from the building footprints and saved to a file,
+ * so later runs answer GIS_isLineOfSight() for points on the map with a single lookup.
+ *
+ * File layout: VisibilityHeader, then 'height*width' rows of 'stride' 64-bit words,
+ * row and column cells numbered y*CITYWIDTH+x. Values are stored in host byte order.
+ */
+#define VISIBILITY_MAGIC "GSVISMAT"
+#define VISIBILITY_VERSION 1
+#define VISIBILITY_CELLS ((size_t)CITYWIDTH*CITYHEIGHT)
+#define VISIBILITY_MAXBYTES ((size_t)1<<30)	// the matrix grows with the square of the cells, larger maps are refused
+
+struct VisibilityHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t width;			// CITYWIDTH and CITYHEIGHT of the map it was built for
+	uint32_t height;
+	uint32_t stride;		// 64-bit words per row
+	double xreference;		// XREFERENCE and YREFERENCE of the map it was built for
+	double yreference;
+};
+
+
+class VisibilityMatrix {
+public:
+	VisibilityMatrix() : m_loaded(false), m_stride(0) {}
+
+	// Works out every cell pair against the buildings, on 'threads' threads.
+	void build(const BuildingIndex &buildings, unsigned int threads);
+
+	// Writes the matrix out, or reads one written for the same map.
+	void save(const string &filename) const;
+	void load(const string &filename);
+
+	// Returns true once build() or load() has run.
+	bool loaded() const { return m_loaded; }
+
+	// Memory a matrix for the current map takes.
+	static size_t bytes() { return VISIBILITY_CELLS*((VISIBILITY_CELLS+63)/64)*sizeof(uint64_t); }
+
+	// Returns true if the centers of the two cells see each other. Cells must be on the map.
+	bool lineOfSight(unsigned short x1, unsigned short y1, unsigned short x2, unsigned short y2) const
+	{
+		size_t bit = (size_t)y2*CITYWIDTH + x2;
+		return (m_bits[((size_t)y1*CITYWIDTH + x1)*m_stride + bit/64] >> (bit%64)) & 1;
+	}
+
+private:
+	bool m_loaded;
+	size_t m_stride;			// rows are padded to whole words, so threads never share one; set for the map in use
+	vector<uint64_t> m_bits;
+
+	// Fills the upper triangle of rows first, first+step, ... (worker thread body).
+	void buildRows(const BuildingIndex *buildings, unsigned int first, unsigned int step);
+};
+
+// Cell-to-cell visibility used by GIS_isLineOfSight() once loaded.
+extern VisibilityMatrix gisVisibility;
+
+#endif /* VISIBILITY_H_ */